@@ -0,0 +1,117 @@
+#!/bin/bash
+#
+# run-bench.sh [-k KERNELS] [-s SIZES] [-f FLOWS] [-r RATE] [-t SECONDS]
+#              [-w SECONDS] [-b CAPACITY] [-n] [-c] [-o DIR]
+#
+# Runs the HVP pipeline benchmarks in this directory, Batcher -> H2D ->
+# [kernel] -> D2H -> PushBatchQueue -> DeBatcher, once for each kernel,
+# frame size and flow count, and prints one line per run: Mpps through
+# the pipeline, and percentiles of the per-batch latency from the
+# Batcher's flush to completion, in usec.
+#
+#   -k: benchmarks to run, default "null checkip lookup", see *.click.
+#   -s: frame sizes in bytes, at least 42, default "64 128 512 1500".
+#   -f: numbers of destination addresses, default "1 1024 65536".
+#   -r: offered load in packets/s, default 0 for as fast as possible.
+#   -t, -w: measured and warmup seconds, default 5 and 1.
+#   -b: batch capacity, default 1024.
+#   -n: run PushBatchQueue in NOTIFY mode rather than polling. Polling
+#       keeps a core busy, so with the host-only g4c it needs another
+#       core for the g4c worker; on a single CPU host, per-batch latency
+#       goes up to around a second, use -n there.
+#   -c: also print per-element cycles per call. The Click build must be
+#       configured with --enable-stats=2.
+#   -o: keep the output of each run in DIR.
+#
+# $CLICK is the userlevel click binary, default ../../userlevel/click or
+# click in PATH. Without a GPU, build against the host-only g4c, see
+# hvpconfigure; its G4C_CPU_* variables emulate bus latency and
+# bandwidth.
+
+KERNELS="null checkip lookup"
+SIZES="64 128 512 1500"
+FLOWS="1 1024 65536"
+RATE=0
+TIME=5
+WARMUP=1
+CAPACITY=1024
+NOTIFY=false
+CYCLES=
+OUTDIR=
+
+while getopts "k:s:f:r:t:w:b:nco:" opt; do
+	case $opt in
+	k) KERNELS=$OPTARG;;
+	s) SIZES=$OPTARG;;
+	f) FLOWS=$OPTARG;;
+	r) RATE=$OPTARG;;
+	t) TIME=$OPTARG;;
+	w) WARMUP=$OPTARG;;
+	b) CAPACITY=$OPTARG;;
+	n) NOTIFY=true;;
+	c) CYCLES=1;;
+	o) OUTDIR=$OPTARG;;
+	*) sed -n '3,4p' $0 >&2; exit 1;;
+	esac
+done
+
+DIR=`cd \`dirname $0\` && pwd`
+if [ -z "$CLICK" ]; then
+	if [ -x $DIR/../../userlevel/click ]; then
+		CLICK=$DIR/../../userlevel/click
+	else
+		CLICK=click
+	fi
+fi
+
+LOG=`mktemp`
+trap "rm -f $LOG" EXIT
+[ -n "$OUTDIR" ] && mkdir -p $OUTDIR
+
+printf "%-8s %5s %6s %8s %8s %8s %8s %8s %8s\n" \
+	kernel size flows Mpps p50 p99 p999 max drops
+for k in $KERNELS; do
+	for s in $SIZES; do
+		for f in $FLOWS; do
+			args=(PAYLOAD=$((s - 42)) FLOWS=$f RATE=$RATE
+			      WARMUP=$WARMUP TIME=$TIME CAPACITY=$CAPACITY
+			      NOTIFY=$NOTIFY)
+			if [ -n "$CYCLES" ]; then
+				args+=(-h '*.cycles')
+			fi
+			(cd $DIR && $CLICK $k.click "${args[@]}") >$LOG 2>&1
+			if [ -n "$OUTDIR" ]; then
+				cp $LOG $OUTDIR/$k-$s-$f.log
+			fi
+
+			if ! grep -q '^packets ' $LOG; then
+				printf "%-8s %5s %6s failed:\n" $k $s $f
+				sed 's/^/  /' $LOG | tail -5
+				continue
+			fi
+
+			awk -v k=$k -v s=$s -v f=$f '
+				$1 == "packets" { pkts = $2 }
+				$1 == "seconds" { secs = $2 }
+				$1 == "drops" { drops = $2 }
+				$1 == "p50" || $1 == "p99" || $1 == "p999" \
+					|| $1 == "max" { v[$1] = $2 }
+				END {
+					printf "%-8s %5s %6s %8.3f %8s %8s %8s %8s %8s\n",
+						k, s, f, pkts / secs / 1e6, v["p50"],
+						v["p99"], v["p999"], v["max"], drops
+				}' $LOG
+
+			if [ -n "$CYCLES" ]; then
+				awk '
+				/\.cycles:$/ { e = substr($1, 1, length($1) - 8) }
+				e && NF == 3 && $2 > 0 {
+					printf "    %-24s %-6s %12d calls %10.1f cycles/call\n",
+						e, $1, $2, $3 / $2
+				}
+				NF == 0 { e = "" }' $LOG
+			fi
+		done
+	done
+done
+exit 0
@@ -72,6 +72,18 @@ EtherEncap::pull(int)
 	return 0;
 }
 
+PBatch *
+EtherEncap::batched_simple_action(PBatch *pb)
+{
+    for (int i = 0; i < pb->size(); i++) {
+	pb->prefetch(i);
+	if (Packet *p = pb->pptrs[i])
+	    if (!(pb->pptrs[i] = smaction(p)))
+		pb->set_dropped(i);
+    }
+    return pb;
+}
+
 void
 EtherEncap::add_handlers()
 {
@@ -61,6 +61,7 @@ class EtherEncap : public Element { public:
     Packet *smaction(Packet *);
     void push(int, Packet *);
     Packet *pull(int);
+    PBatch *batched_simple_action(PBatch *);
 
   private:
 
@@ -225,6 +225,19 @@ CheckIPHeader::simple_action(Packet *p)
   return(p);
 }
 
+PBatch *
+CheckIPHeader::batched_simple_action(PBatch *pb)
+{
+  // Invalid packets leave the batch through drop().
+  for (int i = 0; i < pb->size(); i++) {
+    pb->prefetch(i);
+    if (Packet *p = pb->pptrs[i])
+      if (!(pb->pptrs[i] = CheckIPHeader::simple_action(p)))
+	pb->set_dropped(i);
+  }
+  return pb;
+}
+
 String
 CheckIPHeader::read_handler(Element *e, void *)
 {
@@ -118,6 +118,7 @@ class CheckIPHeader : public Element { public:
   void add_handlers();
 
   Packet *simple_action(Packet *);
+  PBatch *batched_simple_action(PBatch *);
 
   struct OldBadSrcArg {
       static bool parse(const String &str, Vector<IPAddress> &result,
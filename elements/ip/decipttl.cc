@@ -76,6 +76,19 @@ DecIPTTL::simple_action(Packet *p)
     }
 }
 
+PBatch *
+DecIPTTL::batched_simple_action(PBatch *pb)
+{
+    // Expired packets leave the batch through output 1.
+    for (int i = 0; i < pb->size(); i++) {
+	pb->prefetch(i);
+	if (Packet *p = pb->pptrs[i])
+	    if (!(pb->pptrs[i] = DecIPTTL::simple_action(p)))
+		pb->set_dropped(i);
+    }
+    return pb;
+}
+
 void
 DecIPTTL::add_handlers()
 {
@@ -55,6 +55,7 @@ class DecIPTTL : public Element { public:
     void add_handlers();
 
     Packet *simple_action(Packet *);
+    PBatch *batched_simple_action(PBatch *);
 
   private:
 
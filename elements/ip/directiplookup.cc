@@ -525,6 +525,13 @@ DirectIPLookup::push(int, Packet *p)
         p->kill();
 }
 
+void
+DirectIPLookup::bpush(int, PBatch *pb)
+{
+    lookup_batch(this, pb);
+    output_batch(pb);
+}
+
 int
 DirectIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
 {
@@ -98,6 +98,7 @@ class DirectIPLookup : public IPRouteTable { public:
     void add_handlers();
 
     void push(int port, Packet* p);
+    void bpush(int port, PBatch* pb);
 
     int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
     int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
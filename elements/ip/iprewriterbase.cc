@@ -199,6 +199,7 @@ IPRewriterBase::initialize(ErrorHandler *errh)
 	     || _input_specs[i].kind == IPRewriterInput::i_keep)
 	    && _input_specs[i].reply_element->_heap != _heap)
 	    return errh->error("input spec %d: reply element %<%s%> must share this MAPPING_CAPACITY", i, _input_specs[i].reply_element->name().c_str());
+    _gc_timer.set_coarse(true);
     _gc_timer.initialize(this);
     if (_gc_interval_sec)
 	_gc_timer.schedule_after_sec(_gc_interval_sec);
@@ -164,6 +164,42 @@ IPRouteTable::push(int, Packet *p)
     }
 }
 
+void
+IPRouteTable::bpush(int, PBatch *pb)
+{
+    for (int i = 0; i < pb->size(); i++) {
+	pb->prefetch(i);
+	Packet *p = pb->pptrs[i];
+	if (!p)
+	    continue;
+	IPAddress gw;
+	int port = lookup_route(p->dst_ip_anno(), gw);
+	if (port >= 0) {
+	    assert(port < noutputs());
+	    if (gw)
+		p->set_dst_ip_anno(gw);
+	    pb->set_pkt_port(i, port);
+	} else {
+	    static int complained = 0;
+	    if (++complained <= 5)
+		click_chatter("IPRouteTable: no route for %s", p->dst_ip_anno().unparse().c_str());
+	    p->kill();
+	    pb->set_dropped(i);
+	}
+    }
+    output_batch(pb);
+}
+
+void
+IPRouteTable::output_batch(PBatch *pb)
+{
+    if (_outs.size() != noutputs())
+	_outs.resize(noutputs());
+    pb->split(_outs.begin(), _outs.size());
+    for (int port = 0; port < _outs.size(); port++)
+	if (_outs[port])
+	    output(port).bpush(_outs[port]);
+}
 
 int
 IPRouteTable::run_command(int command, const String &str, Vector<IPRoute>* old_routes, ErrorHandler *errh)
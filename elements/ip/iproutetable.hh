@@ -132,6 +132,19 @@ The default implementation of B<push> uses B<lookup_route> to perform IP
 routing lookup. Normally, subclasses implement their own B<push> methods,
 avoiding virtual function call overhead.
 
+=item C<void B<bpush>(int port, PBatch *pb)>
+
+The default implementation of B<bpush> looks up every packet in the batch,
+records the output port in the packet's batch flags, and passes the batch to
+B<output_batch>. Subclasses normally implement their own B<bpush> with
+B<lookup_batch>, which calls the subclass's B<lookup_route> directly.
+
+=item C<void B<output_batch>(PBatch *pb)>
+
+Splits a looked-up batch by output port with PBatch::split, and pushes each
+part on its port. Parts for ports other than the first packet's are
+sub-batches that share the batch's memory.
+
 =item C<static int B<add_route_handler>(const String &, Element *, void *, ErrorHandler *)>
 
 This write handler callback parses its input as an add-route request
@@ -197,6 +210,10 @@ class IPRouteTable : public Element { public:
     virtual String dump_routes();
 
     void push(int port, Packet* p);
+    void bpush(int port, PBatch* pb);
+    void output_batch(PBatch* pb);
+
+    template <typename T> static inline void lookup_batch(const T* table, PBatch* pb);
 
     static int add_route_handler(const String&, Element*, void*, ErrorHandler*);
     static int remove_route_handler(const String&, Element*, void*, ErrorHandler*);
@@ -206,11 +223,34 @@ class IPRouteTable : public Element { public:
 
   private:
 
+    Vector<PBatch*> _outs;	// output_batch scratch space
+
     enum { CMD_ADD, CMD_SET, CMD_REMOVE };
     int run_command(int command, const String &, Vector<IPRoute>* old_routes, ErrorHandler*);
 
 };
 
+template <typename T> inline void
+IPRouteTable::lookup_batch(const T* table, PBatch* pb)
+{
+    for (int i = 0; i < pb->size(); i++) {
+	pb->prefetch(i);
+	Packet* p = pb->pptrs[i];
+	if (!p)
+	    continue;
+	IPAddress gw;
+	int port = table->T::lookup_route(p->dst_ip_anno(), gw);
+	if (port >= 0) {
+	    if (gw)
+		p->set_dst_ip_anno(gw);
+	    pb->set_pkt_port(i, port);
+	} else {
+	    p->kill();
+	    pb->set_dropped(i);
+	}
+    }
+}
+
 inline StringAccum&
 operator<<(StringAccum& sa, const IPRoute& route)
 {
@@ -242,6 +242,13 @@ RadixIPLookup::lookup_route(IPAddress addr, IPAddress &gw) const
     }
 }
 
+void
+RadixIPLookup::bpush(int, PBatch *pb)
+{
+    lookup_batch(this, pb);
+    output_batch(pb);
+}
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(IPRouteTable)
 EXPORT_ELEMENT(RadixIPLookup)
@@ -0,0 +1,124 @@
+#include <click/config.h>
+#include "batchcheckipheader.hh"
+#include <click/error.hh>
+#include <click/confparse.hh>
+#include <clicknet/ip.h>
+#include "batcher.hh"
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+CLICK_DECLS
+
+BatchCheckIPHeader::BatchCheckIPHeader() : _batcher(0), _offset(14), _drops(0)
+{
+}
+
+BatchCheckIPHeader::~BatchCheckIPHeader()
+{
+}
+
+void *
+BatchCheckIPHeader::cast(const char *name)
+{
+	if (strcmp(name, "BatchKernel") == 0)
+		return static_cast<BatchKernel *>(this);
+	return Element::cast(name);
+}
+
+int
+BatchCheckIPHeader::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+	if (cp_va_kparse(conf, this, errh,
+			 "BATCHER", cpkM, cpElementCast, "Batcher", &_batcher,
+			 "OFFSET", cpkN, cpInteger, &_offset,
+			 cpEnd) < 0)
+		return -1;
+
+	_batcher->set_slice_range(_offset, _offset + sizeof(click_ip));
+	_batcher->set_force_pktlens();
+	return 0;
+}
+
+/*
+ * Ones' complement sum of a 20-byte header, 0xFFFF if the checksum is
+ * right.
+ */
+static inline uint32_t
+ip_header_sum(const unsigned char *h)
+{
+#ifdef __SSE2__
+	__m128i a = _mm_loadu_si128((const __m128i *)h);
+	__m128i z = _mm_setzero_si128();
+	__m128i s = _mm_add_epi32(_mm_unpacklo_epi16(a, z),
+				  _mm_unpackhi_epi16(a, z));
+	s = _mm_add_epi32(s, _mm_srli_si128(s, 8));
+	s = _mm_add_epi32(s, _mm_srli_si128(s, 4));
+	uint32_t sum = _mm_cvtsi128_si32(s)
+		+ *(const uint16_t *)(h + 16) + *(const uint16_t *)(h + 18);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return (sum & 0xFFFF) + (sum >> 16);
+#else
+	return click_in_cksum(h, sizeof(click_ip)) == 0 ? 0xFFFF : 0;
+#endif
+}
+
+/*
+ * hpktlens hold the bytes copied from slice_begin, so the IP total length
+ * can only be checked against a packet that ended inside its slice.
+ */
+void
+BatchCheckIPHeader::cpu_kernel(PBatch *pb)
+{
+	int off = _offset - pb->slice_begin;
+
+	for (int i = 0; i < pb->size(); i++) {
+		if (pb->dropped(i) || pb->pkt_bad(i))
+			continue;
+
+		const unsigned char *h = (pb->zero_copy ? pb->hzslice(i) : pb->hslice(i)) + off;
+		int caplen = *pb->hpktlen(i);
+		int avail = caplen - off;
+		int hlen = (h[0] & 0xF) << 2;
+		bool ok;
+
+		if (avail < (int)sizeof(click_ip))
+			ok = false;
+		else if (h[0] == 0x45)
+			ok = ip_header_sum(h) == 0xFFFF;
+		else if ((h[0] >> 4) != 4 || hlen < (int)sizeof(click_ip))
+			ok = false;
+		else if (hlen <= avail)
+			ok = click_in_cksum(h, hlen) == 0;
+		else
+			ok = true;	// options beyond the slice
+
+		if (ok) {
+			int len = (h[2] << 8) | h[3];
+			bool whole = pb->slice_end < 0 || caplen < pb->slice_length;
+			ok = len >= hlen && (!whole || len <= avail);
+		}
+
+		if (!ok) {
+			*pb->hpktflag(i) |= PBATCH_PKT_BAD;
+			_drops++;
+		}
+	}
+}
+
+PBatch *
+BatchCheckIPHeader::batched_simple_action(PBatch *pb)
+{
+	cpu_kernel(pb);
+	return pb;
+}
+
+void
+BatchCheckIPHeader::add_handlers()
+{
+	add_data_handlers("drops", Handler::OP_READ, &_drops);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(Batcher)
+EXPORT_ELEMENT(BatchCheckIPHeader)
+ELEMENT_LIBS(-lg4c)
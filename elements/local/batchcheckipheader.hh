@@ -0,0 +1,48 @@
+#ifndef CLICK_BATCHCHECKIPHEADER_HH
+#define CLICK_BATCHCHECKIPHEADER_HH
+#include <click/element.hh>
+#include <click/glue.hh>
+#include <click/pbatch.hh>
+#include "batchkernel.hh"
+CLICK_DECLS
+
+class Batcher;
+
+/**
+ * BatchCheckIPHeader checks the IPv4 headers of a batch from its slices,
+ * with SSE2 checksums where available. Packets with a bad version, header
+ * length, total length or checksum are marked PBATCH_PKT_BAD. A header
+ * with options is only checksummed if it fits in the slice. Unlike
+ * CheckIPHeader, it neither trims packets nor sets annotations.
+ *
+ * Configurations:
+ *   BATCHER: element, the Batcher of the batches. Required, the slice
+ *            range and packet lengths are requested from it.
+ *   OFFSET: int value, offset of the IP header in packet data, default 14.
+ *
+ * Handlers:
+ *   drops: packets marked bad.
+ */
+class BatchCheckIPHeader : public Element, public BatchKernel {
+public:
+	BatchCheckIPHeader();
+	~BatchCheckIPHeader();
+
+	const char *class_name() const { return "BatchCheckIPHeader"; }
+	const char *port_count() const { return PORTS_1_1; }
+	void *cast(const char *name);
+
+	int configure(Vector<String> &conf, ErrorHandler *errh);
+	void add_handlers();
+
+	PBatch *batched_simple_action(PBatch *pb);
+	void cpu_kernel(PBatch *pb);
+
+private:
+	Batcher *_batcher;
+	int _offset;
+	uint32_t _drops;
+};
+
+CLICK_ENDDECLS
+#endif
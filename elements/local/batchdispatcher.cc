@@ -0,0 +1,94 @@
+#include <click/config.h>
+#include "batchdispatcher.hh"
+#include <click/error.hh>
+#include <click/hvputils.hh>
+#include <click/confparse.hh>
+#include "batchkernel.hh"
+#include "streamscheduler.hh"
+CLICK_DECLS
+
+BatchDispatcher::BatchDispatcher() : _kernel(0), _scheduler(0),
+				     _min_device_batch(64), _max_delay_us(0),
+				     _probe_interval(Timestamp::make_msec(10)),
+				     _cpu_batches(0), _device_batches(0),
+				     _probe_batches(0)
+{
+}
+
+BatchDispatcher::~BatchDispatcher()
+{
+}
+
+int
+BatchDispatcher::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+	Element *e = 0;
+	Timestamp delay;
+
+	if (cp_va_kparse(conf, this, errh,
+			 "KERNEL", cpkM, cpElement, &e,
+			 "MIN_DEVICE_BATCH", cpkN, cpInteger, &_min_device_batch,
+			 "SCHEDULER", cpkN, cpElementCast, "StreamScheduler", &_scheduler,
+			 "MAX_DEVICE_DELAY", cpkN, cpTimestamp, &delay,
+			 "PROBE_INTERVAL", cpkN, cpTimestamp, &_probe_interval,
+			 cpEnd) < 0)
+		return -1;
+
+	if (!(_kernel = (BatchKernel *)e->cast("BatchKernel")))
+		return errh->error("KERNEL %<%s%> is not a batch kernel", e->name().c_str());
+	_max_delay_us = delay.usecval();
+	return 0;
+}
+
+bool
+BatchDispatcher::on_cpu(PBatch *pb)
+{
+	if (pb->size() < _min_device_batch)
+		return true;
+	if (!_scheduler)
+		return false;
+	if (_scheduler->backlog() > 0)
+		return true;
+	if (!_max_delay_us || _scheduler->latency_us() <= _max_delay_us)
+		return false;
+
+	// Nothing else updates the latency, so probe the device now and then.
+	Timestamp now = Timestamp::now_steady();
+	if (now - _last_probe < _probe_interval)
+		return true;
+	_last_probe = now;
+	_probe_batches++;
+	return false;
+}
+
+void
+BatchDispatcher::push(int i, Packet *p)
+{
+	hvp_chatter("Error: BatchDispatcher's push should not be called!\n");
+}
+
+void
+BatchDispatcher::bpush(int i, PBatch *pb)
+{
+	if (on_cpu(pb)) {
+		_cpu_batches++;
+		_kernel->cpu_kernel(pb);
+		output(1).bpush(pb);
+	} else {
+		_device_batches++;
+		output(0).bpush(pb);
+	}
+}
+
+void
+BatchDispatcher::add_handlers()
+{
+	add_data_handlers("cpu_batches", Handler::OP_READ, &_cpu_batches);
+	add_data_handlers("device_batches", Handler::OP_READ, &_device_batches);
+	add_data_handlers("probe_batches", Handler::OP_READ, &_probe_batches);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(Batcher)
+EXPORT_ELEMENT(BatchDispatcher)
+ELEMENT_LIBS(-lg4c)
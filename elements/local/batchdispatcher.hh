@@ -0,0 +1,71 @@
+#ifndef CLICK_BATCHDISPATCHER_HH
+#define CLICK_BATCHDISPATCHER_HH
+#include <click/element.hh>
+#include <click/glue.hh>
+#include <click/pbatch.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+class BatchKernel;
+class StreamScheduler;
+
+/**
+ * BatchDispatcher decides per batch whether a stage runs on the device or
+ * on the CPU. A batch goes out on output 0, towards the device path, or
+ * KERNEL runs it at once on the CPU and it goes out on output 1. The CPU
+ * is chosen for batches smaller than MIN_DEVICE_BATCH, whose transfers
+ * would cost more than the work, and, with SCHEDULER, while the device is
+ * backed up: batches are waiting for a stream, or the average completion
+ * time is over MAX_DEVICE_DELAY. The average only moves as device batches
+ * complete, so while it is over the limit one batch every PROBE_INTERVAL
+ * still goes to the device, and the dispatcher returns to it once the
+ * probes come back fast enough.
+ *
+ * Configurations:
+ *   KERNEL: element, a batch kernel element such as BatchCheckIPHeader or
+ *           BatchIPLookup. Required.
+ *   MIN_DEVICE_BATCH: int value, smallest batch sent to the device,
+ *                     default 64.
+ *   SCHEDULER: element, the StreamScheduler of the device path.
+ *   MAX_DEVICE_DELAY: time value, completion time above which batches
+ *                     stay on the CPU, default 0 for no limit.
+ *   PROBE_INTERVAL: time value, how often a batch goes to the device while
+ *                   the completion time is over the limit, default 10ms.
+ *
+ * Handlers:
+ *   cpu_batches: batches run on the CPU.
+ *   device_batches: batches sent to the device.
+ *   probe_batches: device batches sent over the delay limit.
+ */
+class BatchDispatcher : public Element {
+public:
+	BatchDispatcher();
+	~BatchDispatcher();
+
+	const char *class_name() const { return "BatchDispatcher"; }
+	const char *port_count() const { return "1/2"; }
+	const char *processing() const { return PUSH; }
+
+	void push(int i, Packet *p); // Should never be called.
+	void bpush(int i, PBatch *pb);
+
+	int configure(Vector<String> &conf, ErrorHandler *errh);
+	void add_handlers();
+
+private:
+	BatchKernel *_kernel;
+	StreamScheduler *_scheduler;
+	int _min_device_batch;
+	uint32_t _max_delay_us;
+	Timestamp _probe_interval;
+	Timestamp _last_probe;
+
+	uint32_t _cpu_batches;
+	uint32_t _device_batches;
+	uint32_t _probe_batches;
+
+	bool on_cpu(PBatch *pb);
+};
+
+CLICK_ENDDECLS
+#endif
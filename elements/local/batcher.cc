@@ -5,11 +5,222 @@
 #include <click/standard/alignmentinfo.hh>
 #include <click/hvputils.hh>
 #include <click/confparse.hh>
+#include <click/straccum.hh>
 #include <click/pbatch.hh>
 #include <click/timestamp.hh>
+#include <click/master.hh>
+#include <click/routervisitor.hh>
+#include <click/standard/scheduleinfo.hh>
 CLICK_DECLS
 
-Batcher::Batcher(): _timer(this)
+PBatchPool::PBatchPool(int nlists)
+	: _nlists(nlists > 0 ? nlists : 1), _size(0),
+	  _misses(0), _high_water(0)
+{
+	_lists = new freelist[_nlists];
+	_in_use = 0;
+}
+
+PBatchPool::~PBatchPool()
+{
+	for (int i = 0; i < _nlists; i++) {
+		PBatch *pb;
+		while ((pb = _lists[i].head)) {
+			_lists[i].head = pb->pool_next;
+			pb->pool = 0;
+			Batcher::destroy_batch(pb);
+		}
+	}
+	delete[] _lists;
+}
+
+inline int
+PBatchPool::current_list() const
+{
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD && HAVE___THREAD_STORAGE_CLASS
+	if ((unsigned)click_current_thread_id < (unsigned)_nlists)
+		return click_current_thread_id;
+#endif
+	return 0;
+}
+
+inline void
+PBatchPool::note_get()
+{
+	uint32_t n = _in_use.fetch_and_add(1) + 1;
+	if (n > _high_water)
+		_high_water = n;
+}
+
+void
+PBatchPool::push_list(int i, PBatch *chain)
+{
+	PBatch *tail = chain;
+	while (tail->pool_next)
+		tail = tail->pool_next;
+
+	_lists[i].lock.acquire();
+	tail->pool_next = _lists[i].head;
+	_lists[i].head = chain;
+	_lists[i].lock.release();
+}
+
+PBatch *
+PBatchPool::take_list(int i)
+{
+	_lists[i].lock.acquire();
+	PBatch *chain = _lists[i].head;
+	_lists[i].head = 0;
+	_lists[i].lock.release();
+	return chain;
+}
+
+/*
+ * Called by the owning Batcher only. Tries the current thread's free
+ * list first, then grabs the whole list of another thread.
+ */
+PBatch *
+PBatchPool::get()
+{
+	int me = current_list();
+	PBatch *pb;
+
+	_lists[me].lock.acquire();
+	if ((pb = _lists[me].head)) {
+		_lists[me].head = pb->pool_next;
+		_lists[me].gets++;
+	}
+	_lists[me].lock.release();
+
+	for (int i = 1; !pb && i < _nlists; i++) {
+		if ((pb = take_list((me + i) % _nlists))) {
+			_lists[me].steals++;
+			if (pb->pool_next)
+				push_list(me, pb->pool_next);
+		}
+	}
+
+	if (!pb) {
+		_lists[me].misses++;
+		_misses++;
+		return 0;
+	}
+
+	pb->pool_next = 0;
+	note_get();
+	return pb;
+}
+
+/*
+ * Return a killed batch, may be called on any thread.
+ */
+void
+PBatchPool::put(PBatch *pb)
+{
+	pb->npkts = 0;
+	pb->row_begin = 0;
+	pb->row_end = -1;
+	pb->dev_stream = 0;
+	pb->stream_owner = 0;
+	pb->h2d_bytes = 0;
+	pb->d2h_bytes = 0;
+
+	freelist &fl = _lists[current_list()];
+	fl.lock.acquire();
+	if (fl.detached) {
+		fl.lock.release();
+		pb->pool = 0;
+		Batcher::destroy_batch(pb);
+		if (_in_use.dec_and_test())
+			delete this;
+		return;
+	}
+	pb->pool_next = fl.head;
+	fl.head = pb;
+	fl.puts++;
+	// under the lock, so detach() sees every batch it did not find
+	// in a free list still counted
+	_in_use--;
+	fl.lock.release();
+}
+
+/*
+ * Add a new free batch to the pool.
+ */
+void
+PBatchPool::add(PBatch *pb)
+{
+	pb->pool = this;
+	pb->pool_next = 0;
+	_size++;
+	push_list(current_list(), pb);
+}
+
+/*
+ * Add a new batch that is handed out right away, after a miss.
+ */
+void
+PBatchPool::adopt(PBatch *pb)
+{
+	pb->pool = this;
+	pb->pool_next = 0;
+	_size++;
+	note_get();
+}
+
+/*
+ * The owner is going away: free what is in the pool now, and let
+ * batches still in flight free themselves when they are killed. Only
+ * this walks all the lists; put() only ever takes its own list's lock.
+ */
+void
+PBatchPool::detach()
+{
+	// our own reference, so the last put() cannot free the pool while
+	// we still walk the lists
+	_in_use++;
+	for (int i = 0; i < _nlists; i++) {
+		_lists[i].lock.acquire();
+		_lists[i].detached = true;
+		PBatch *pb = _lists[i].head;
+		_lists[i].head = 0;
+		_lists[i].lock.release();
+
+		while (pb) {
+			PBatch *next = pb->pool_next;
+			pb->pool = 0;
+			Batcher::destroy_batch(pb);
+			pb = next;
+		}
+	}
+	if (_in_use.dec_and_test())
+		delete this;
+}
+
+String
+PBatchPool::thread_stats() const
+{
+	StringAccum sa;
+	for (int i = 0; i < _nlists; i++)
+		sa << i << ' ' << _lists[i].gets << ' ' << _lists[i].puts << ' '
+		   << _lists[i].steals << ' ' << _lists[i].misses << '\n';
+	return sa.take_string();
+}
+
+
+#if CLICK_DEBUG_PBATCH
+/*
+ * Freed batch structs are kept here as tombstones for a while, with no
+ * references and no memory, so a double kill finds refs == 0 instead of
+ * reading freed memory.
+ */
+enum { ntombstones = 1024 };
+static PBatch *tombstones[ntombstones];
+static unsigned tombstone_next;
+static SimpleSpinlock tombstone_lock;
+#endif
+
+Batcher::Batcher(): _timer(this), _idle_task(this)
 {
 	_count = 0;
 	_drops = 0;
@@ -19,11 +230,30 @@ Batcher::Batcher(): _timer(this)
 	_slice_begin = 0;
 	_slice_end = 0;
 	_anno_flags = 0;
+	_field_flags = 0;
 	_timeout_ms = CLICK_BATCH_TIMEOUT;
 	_force_pktlens = false;
 	_timed_batch = 0;
 	_nr_users = 0;
 	_user_priv_len = 0;
+	_pool_size = 0;
+	_pool = 0;
+	_adaptive = false;
+	_slo_us = 1000;
+	_min_batch = 32;
+	_target_size = _batch_capacity;
+	_deadline_us = 0;
+	_flush_full = 0;
+	_flush_timeout = 0;
+	_flush_idle = 0;
+	_flush_region = 0;
+	_flush_on_idle = false;
+	_zero_copy = false;
+	_region = 0;
+	_region_gen = 0;
+	_zc_misses = 0;
+	_trace = 0;
+	_trace_ring = 0;
 	_test = false;
 }
 
@@ -31,64 +261,161 @@ Batcher::~Batcher()
 {
 }
 
+#if CLICK_DEBUG_PBATCH
 /*
- * Considering fixed size user private data so that we can use
- * a memory pool for PBatch allocation.
+ * Runs after every element of the router has been cleaned up, so the
+ * batches still live were never killed.
+ */
+void
+Batcher::check_leaks(Router *, void *)
+{
+	if (PBatch::nlive.value())
+		click_chatter("Batcher: %u batches leaked", PBatch::nlive.value());
+}
+#endif
+
+/*
+ * Allocate a batch with its host, device and user private memory.
+ * All batches of a Batcher have the same geometry, so they can be
+ * recycled by the pool.
  */
+PBatch*
+Batcher::create_batch()
+{
+	PBatch *pb = new PBatch(_batch_capacity, _slice_begin, _slice_end, _force_pktlens,
+				_anno_flags, Packet::anno_size, _zero_copy, _field_flags);
+	if (!pb)
+		return 0;
+
+	pb->init_for_host_batching();
+	pb->hostmem = g4c_alloc_page_lock_mem(pb->memsize);
+	pb->devmem = g4c_alloc_dev_mem(pb->memsize);
+	pb->set_pointers();
+
+	// TODO:
+	//   A better option is to not copy flags, lunching a kernel
+	//   to init device size pktflags or using cudaMemset.
+	if (pb->zero_copy) {
+		pb->hwork_ptr = (void*)pb->hpktoffs;
+		pb->dwork_ptr = (void*)pb->dpktoffs;
+	} else {
+		pb->hwork_ptr = (void*)pb->hslices;
+		pb->dwork_ptr = (void*)pb->dslices;
+	}
+	pb->work_size = pb->memsize -
+		g4c_ptr_offset(pb->hwork_ptr, pb->hostmem);
+
+	pb->nr_users = _nr_users;
+	pb->user_priv_len = _user_priv_len;
+	if (_user_priv_len != 0) {
+		pb->user_priv = malloc(_user_priv_len);
+		if (!pb->user_priv) {
+			hvp_chatter("Out of memory.\n");
+			destroy_batch(pb);
+			return 0;
+		}
+	}
+
+	return pb;
+}
+
 PBatch*
 Batcher::alloc_batch()
 {
-	_batch = new PBatch(_batch_capacity, _slice_begin, _slice_end, _force_pktlens,
-			    _anno_flags, Packet::anno_size);
+	_batch = 0;
+	if (_pool)
+		_batch = _pool->get();
+
+	if (!_batch) {
+		_batch = create_batch();
+		if (_batch && _pool)
+			_pool->adopt(_batch);
+	}
+
 	if (_batch) {
-		_batch->init_for_host_batching();
-		_batch->hostmem = g4c_alloc_page_lock_mem(_batch->memsize);
-		_batch->devmem = g4c_alloc_dev_mem(_batch->memsize);
-		_batch->set_pointers();
-
-		// TODO:
-		//   A better option is to not copy flags, lunching a kernel
-		//   to init device size pktflags or using cudaMemset.
-		_batch->hwork_ptr = (void*)_batch->hslices; 
-		_batch->dwork_ptr = (void*)_batch->dslices;
-		_batch->work_size = _batch->memsize -
-			g4c_ptr_offset(_batch->hslices, _batch->hpktflags);
-
-		_batch->nr_users = _nr_users;
-		_batch->user_priv_len = _user_priv_len;
-		if (_user_priv_len != 0) {
-			_batch->user_priv = malloc(_user_priv_len);
-			if (!_batch->user_priv) {
-				hvp_chatter("Out of memory.\n");
-				kill_batch(_batch);
-				_batch = 0;
-			}
+		_batch->init_refs();
+		_batch->trace = _trace;
+		if (_trace) {
+			_trace->use();
+			memset(_batch->tstamps, 0, sizeof(_batch->tstamps));
 		}
 	}
-
 	_cur_batch_size = 0;
-	
+
 	return _batch;
 }
 
+/*
+ * Drop a reference to the batch, and free it or return it to its pool if
+ * that was the last one. Safe to call from any thread.
+ */
 bool
 Batcher::kill_batch(PBatch *pb)
 {
-	pb->shared--;
-	if (pb->shared < 0) {
-		g4c_free_page_lock_mem(pb->hostmem);
-		g4c_free_dev_mem(pb->devmem);
-
-		g4c_free_stream(pb->dev_stream);
-		if (pb->user_priv)
-			free(pb->user_priv);
-		delete pb;
+	if (pb->release()) {
+		if (pb->trace) {
+			pb->trace->unuse();
+			pb->trace = 0;
+		}
+		if (pb->stream_owner) {
+			pb->stream_owner->stream_released(pb);
+			pb->stream_owner = 0;
+		} else
+			g4c_free_stream(pb->dev_stream);
+		if (pb->parent) {
+			// Sub-batch, the memory belongs to the parent.
+			PBatch *parent = pb->parent;
+			pb->clean_for_host_batching();
+			free_batch(pb);
+			kill_batch(parent);
+		} else if (pb->pool)
+			pb->pool->put(pb);
+		else
+			destroy_batch(pb);
 		return true;
 	}
 
 	return false;
 }
 
+void
+Batcher::destroy_batch(PBatch *pb)
+{
+	g4c_free_page_lock_mem(pb->hostmem);
+	g4c_free_dev_mem(pb->devmem);
+
+	if (pb->user_priv)
+		free(pb->user_priv);
+	pb->clean_for_host_batching();
+	free_batch(pb);
+}
+
+/*
+ * Free the PBatch struct itself, its memory is already gone.
+ */
+void
+Batcher::free_batch(PBatch *pb)
+{
+#if CLICK_DEBUG_PBATCH
+	pb->refs = 0;
+	pb->npkts = 0;
+	pb->pptrs = 0;
+	pb->hostmem = 0;
+	pb->devmem = 0;
+	pb->user_priv = 0;
+	pb->parent = 0;
+	pb->pool = 0;
+	pb->stream_owner = 0;
+	tombstone_lock.acquire();
+	PBatch *old = tombstones[tombstone_next];
+	tombstones[tombstone_next] = pb;
+	tombstone_next = (tombstone_next + 1) % ntombstones;
+	tombstone_lock.release();
+	pb = old;
+#endif
+	delete pb;
+}
+
 /**
  * Pre-condition: _batch exists, _batch not full. Packet p checked.
  */
@@ -98,22 +425,29 @@ Batcher::add_packet(Packet *p)
 	int idx = _batch->size();
 
 	if (p->has_mac_header() || _test) {
-		_batch->npkts++;
-		_batch->pptrs[idx] = p;
-		_cur_batch_size = _batch->size();
+		if (_batch->zero_copy) {
+			if (!add_packet_zero_copy(p))
+				return;
+			idx = _batch->size() - 1;
+		} else {
+			_batch->npkts++;
+			_batch->pptrs[idx] = p;
+			_cur_batch_size = _batch->size();
 
-		unsigned long copysz = p->end_data() - (_test?p->data():p->mac_header());
-		if (_batch->slice_end > 0 && copysz > (unsigned long)_batch->slice_length)
-			copysz = _batch->slice_length;
+			unsigned long copysz = p->end_data() - (_test?p->data():p->mac_header());
+			if (_batch->slice_end > 0 && copysz > (unsigned long)_batch->slice_length)
+				copysz = _batch->slice_length;
 
-		if (_batch->hpktlens) {
-			*_batch->hpktlen(idx) = copysz;
-		}
+			if (_batch->hpktlens) {
+				*_batch->hpktlen(idx) = copysz;
+			}
 
-		_batch->hpktflags = 0;
-		memcpy(_batch->hslice(idx),
-		       (_test?p->data():p->mac_header())+_batch->slice_begin,
-		       copysz);
+			*_batch->hpktflag(idx) = 0;
+			if (_batch->slice_size)
+				memcpy(_batch->hslice(idx),
+				       (_test?p->data():p->mac_header())+_batch->slice_begin,
+				       copysz);
+		}
 		
 		if (_batch->anno_flags & PBATCH_ANNO_READ) {
 			memcpy(_batch->hanno(idx),
@@ -121,8 +455,19 @@ Batcher::add_packet(Packet *p)
 			       Packet::anno_size);
 		}
 
-		if (idx == 0 && _timeout_ms > 0) {			
-			_timer.schedule_after_msec(_timeout_ms);
+		if (_batch->field_flags) {
+			const unsigned char *mac = _test?p->data():p->mac_header();
+			_batch->parse_fields(idx, mac, p->end_data() - mac);
+		}
+
+		if (idx == 0)
+			_batch->stamp(PBATCH_TS_FIRST);
+
+		if (idx == 0 && _adaptive) {
+			_timer.schedule_after(Timestamp::make_usec(_deadline_us));
+			_timed_batch = _batch;
+		} else if (idx == 0 && _timeout) {
+			_timer.schedule_after(_timeout);
 			_timed_batch = _batch;
 		}
 	} else {
@@ -132,52 +477,350 @@ Batcher::add_packet(Packet *p)
 	}	
 }
 
+/**
+ * Zero-copy part of add_packet(): record the slice's offset into the
+ * registered region holding the packet instead of copying it. A batch
+ * refers to one region only, so a packet from another region flushes
+ * the current batch first. Returns false if the packet was dropped.
+ */
+bool
+Batcher::add_packet_zero_copy(Packet *p)
+{
+	const unsigned char *data = (_test?p->data():p->mac_header()) + _batch->slice_begin;
+	const PBatchRegion *r = _region;
+
+	if (!r || r->gen != _region_gen || !r->contains(data)) {
+		if (!(r = PBatchRegion::find(data))) {
+			_zc_misses++;
+			_drops++;
+			p->kill();
+			return false;
+		}
+		// The entry may have been reused since the batch's packets
+		// were added, so compare the generation too.
+		if (_batch->size() > 0
+		    && (_batch->region != r || r->gen != _region_gen)) {
+			if (_timer.scheduled())
+				_timer.clear();
+			PBatch *oldbatch = _batch;
+			alloc_batch();
+			flush_batch(oldbatch, flush_region);
+		}
+		_region = r;
+		_region_gen = r->gen;
+	}
+
+	int idx = _batch->size();
+	_batch->npkts++;
+	_batch->pptrs[idx] = p;
+	_batch->region = r;
+	_cur_batch_size = _batch->size();
+
+	long len = p->end_data() - data;
+	if (len < 0)
+		len = 0;
+	if (_batch->slice_end > 0 && len > _batch->slice_length)
+		len = _batch->slice_length;
+
+	_batch->hpktoffs[idx] = data - r->hbase;
+	*_batch->hpktlen(idx) = len;
+	*_batch->hpktflag(idx) = 0;
+	return true;
+}
+
 void
 Batcher::push(int i, Packet *p)
 {
-	if (!_batch) {
-		alloc_batch();		
-	}
+	batch_packet(p);
+}
 
-	add_packet(p);
-	_count++;
-	
-	if (_batch->full()) {
-		if (_test) {
-			hvp_chatter("batch %p full at %s\n", _batch,
-				    Timestamp::now().unparse().c_str());
+void
+Batcher::flush_batch(PBatch *pb, int reason)
+{
+	if (reason == flush_timeout)
+		_flush_timeout++;
+	else if (reason == flush_idle)
+		_flush_idle++;
+	else if (reason == flush_region)
+		_flush_region++;
+	else
+		_flush_full++;
+	_fill.update((uint64_t)pb->size() * 100 / pb->capacity);
+
+	Timestamp now = Timestamp::now_steady();
+	pb->tflush = now;
+	pb->stamp(PBATCH_TS_FLUSH);
+	if (_adaptive) {
+		if (_last_flush) {
+			uint64_t us = (now - _last_flush).usecval();
+			_rate.update((uint64_t)pb->size() * 1000000 / (us ? us : 1));
 		}
-		if (_timer.scheduled())
-			_timer.clear();
-		PBatch *oldbatch = _batch;
-		alloc_batch();
-		output(0).bpush(oldbatch);
+		_last_flush = now;
+		adapt();
 	}
+
+	output(0).bpush(pb);
+}
+
+/*
+ * Pick the batch size and flush deadline: the first packet of a batch
+ * may wait for as long as the latency SLO minus the observed
+ * queue-to-completion latency, and the batch should be as large as
+ * the arrival rate fills in that time.
+ */
+void
+Batcher::adapt()
+{
+	uint64_t lat = _latency.unscaled_average();
+	uint64_t wait = _slo_us > lat ? _slo_us - lat : 0;
+	uint64_t n = _rate.unscaled_average() * wait / 1000000;
+
+	if (n < (uint64_t)_min_batch)
+		n = _min_batch;
+	if (n > (uint64_t)_batch_capacity)
+		n = _batch_capacity;
+	_target_size = n;
+	_deadline_us = wait ? wait : 1;
+}
+
+void
+Batcher::batch_completed(PBatch *pb)
+{
+	if (_adaptive && pb->tflush)
+		_latency.update((Timestamp::now_steady() - pb->tflush).usecval());
 }
 
 int
 Batcher::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+	bool has_flush_timeout = false;
+	bool trace = false;
+
 	if (cp_va_kparse(conf, this, errh,
 			 "TIMEOUT", cpkN, cpInteger, &_timeout_ms,
+			 "FLUSH_TIMEOUT", cpkC, &has_flush_timeout, cpTimestamp, &_timeout,
+			 "FLUSH_ON_IDLE", cpkN, cpBool, &_flush_on_idle,
 			 "SLICE_BEGIN", cpkN, cpInteger, &_slice_begin,
 			 "SLICE_END", cpkN, cpInteger, &_slice_end,
 			 "CAPACITY", cpkN, cpInteger, &_batch_capacity,
 			 "ANN_FLAGS", cpkN, cpByte, &_anno_flags,
+			 "FIELDS", cpkN, cpByte, &_field_flags,
 			 "FORCE_PKTLENS", cpkN, cpBool, &_force_pktlens,
+			 "POOL_SIZE", cpkN, cpInteger, &_pool_size,
+			 "ZERO_COPY", cpkN, cpBool, &_zero_copy,
+			 "ADAPTIVE", cpkN, cpBool, &_adaptive,
+			 "LATENCY_SLO", cpkN, cpSecondsAsMicro, &_slo_us,
+			 "MIN_BATCH", cpkN, cpInteger, &_min_batch,
+			 "TRACE", cpkN, cpBool, &trace,
+			 "TRACE_RING", cpkN, cpUnsigned, &_trace_ring,
+			 "TRACE_FILE", cpkN, cpFilename, &_trace_file,
 			 "TEST", cpkN, cpBool, &_test,
 			 cpEnd) < 0)
 		return -1;
+	if (_pool_size < 0)
+		return errh->error("POOL_SIZE must be >= 0");
+#if !HAVE_NET_NETMAP_H
+	if (_zero_copy)
+		return errh->error("ZERO_COPY requires netmap");
+#endif
+	if (!has_flush_timeout)
+		_timeout = Timestamp::make_msec(_timeout_ms > 0 ? _timeout_ms : 0);
+	if (_batch_capacity <= 0)
+		return errh->error("CAPACITY must be > 0");
+	if (_adaptive && _slo_us == 0)
+		return errh->error("LATENCY_SLO must be > 0");
+	if (_min_batch < 1)
+		_min_batch = 1;
+	if (_min_batch > _batch_capacity)
+		_min_batch = _batch_capacity;
+
+	_target_size = _batch_capacity;
+	if (_adaptive)
+		adapt();
+
+	if (trace || _trace_ring || _trace_file) {
+		if (!(_trace = new PBatchTrace)
+		    || _trace->set_ring_size(_trace_ring) < 0)
+			return errh->error("out of memory");
+	}
 	return 0;
 }
 
+namespace {
+/*
+ * Finds idle notifiers upstream, passing through push elements.
+ */
+class IdleNotifierVisitor : public RouterVisitor { public:
+	Vector<Notifier *> _notifiers;
+	bool visit(Element *e, bool isoutput, int port, Element *, int, int) {
+		if (Notifier *n = (Notifier *)e->port_cast(isoutput, port,
+							   Notifier::IDLE_NOTIFIER)) {
+			_notifiers.push_back(n);
+			return false;
+		}
+		return true;
+	}
+};
+}
+
 int
 Batcher::initialize(ErrorHandler *errh)
 {
 	_timer.initialize(this);
+
+#if CLICK_DEBUG_PBATCH
+	void *&leak_check = router()->force_attachment("Batcher.check_leaks");
+	if (!leak_check) {
+		router()->add_cleanup_hook(check_leaks, 0);
+		leak_check = this;
+	}
+#endif
+
+	if (_flush_on_idle) {
+		IdleNotifierVisitor v;
+		router()->visit_upstream(this, 0, &v);
+		if (v._notifiers.size() == 0)
+			errh->warning("FLUSH_ON_IDLE: no upstream source reports idleness");
+		ScheduleInfo::initialize_task(this, &_idle_task, false, errh);
+		for (int i = 0; i < v._notifiers.size(); i++)
+			v._notifiers[i]->add_listener(&_idle_task);
+	}
+
+	if (_pool_size > 0) {
+		_pool = new PBatchPool(master()->nthreads());
+		if (!_pool)
+			return errh->error("out of memory");
+		for (int i = 0; i < _pool_size; i++) {
+			PBatch *pb = create_batch();
+			if (!pb)
+				return errh->error("cannot preallocate batch %d of %d",
+						   i, _pool_size);
+			_pool->add(pb);
+		}
+	}
 	return 0;
 }
 
+void
+Batcher::cleanup(CleanupStage stage)
+{
+	if (_batch) {
+		for (int i = 0; i < _batch->size(); i++)
+			_batch->pptrs[i]->kill();
+		_batch->npkts = 0;
+		kill_batch(_batch);
+		_batch = 0;
+	}
+	if (_pool) {
+		_pool->detach();
+		_pool = 0;
+	}
+	if (_trace) {
+		if (_trace_file && stage == CLEANUP_ROUTER_INITIALIZED)
+			_trace->dump(_trace_file, ErrorHandler::default_handler());
+		_trace->unuse();
+		_trace = 0;
+	}
+}
+
+enum { h_pool_size, h_pool_in_use, h_pool_misses, h_pool_high_water, h_pool_thread_stats,
+       h_batch_size, h_timeout_us, h_fill_ratio, h_flush_full, h_flush_timeout,
+       h_flush_idle, h_flush_region, h_arrival_rate, h_completion_latency, h_zc_misses,
+       h_stages, h_trace_reset, h_trace_dump };
+
+String
+Batcher::read_handler(Element *e, void *thunk)
+{
+	Batcher *b = static_cast<Batcher *>(e);
+	PBatchPool *pool = b->_pool;
+
+	switch ((intptr_t)thunk) {
+	case h_pool_size:
+		return String(pool ? pool->size() : 0);
+	case h_pool_in_use:
+		return String(pool ? pool->in_use() : 0);
+	case h_pool_misses:
+		return String(pool ? pool->misses() : 0);
+	case h_pool_high_water:
+		return String(pool ? pool->high_water() : 0);
+	case h_pool_thread_stats:
+		return pool ? pool->thread_stats() : String();
+	case h_batch_size:
+		return String(b->_target_size);
+	case h_timeout_us:
+		return String(b->_adaptive ? (int64_t)b->_deadline_us : (int64_t)b->_timeout.usecval());
+	case h_fill_ratio:
+		return b->_fill.unparse();
+	case h_flush_full:
+		return String(b->_flush_full);
+	case h_flush_timeout:
+		return String(b->_flush_timeout);
+	case h_flush_region:
+		return String(b->_flush_region);
+	case h_flush_idle:
+		return String(b->_flush_idle);
+	case h_arrival_rate:
+		return b->_rate.unparse();
+	case h_completion_latency:
+		return b->_latency.unparse();
+	case h_zc_misses:
+		return String(b->_zc_misses);
+	case h_stages:
+		return b->_trace ? b->_trace->unparse() : String();
+	default:
+		return String();
+	}
+}
+
+int
+Batcher::write_handler(const String &str, Element *e, void *thunk,
+		       ErrorHandler *errh)
+{
+	Batcher *b = static_cast<Batcher *>(e);
+
+	if (!b->_trace)
+		return errh->error("not tracing, see TRACE");
+
+	switch ((intptr_t)thunk) {
+	case h_trace_reset:
+		b->_trace->clear();
+		return 0;
+	case h_trace_dump: {
+		String file = cp_uncomment(str);
+		if (!file)
+			file = b->_trace_file;
+		if (!file)
+			return errh->error("no file given and no TRACE_FILE");
+		return b->_trace->dump(file, errh);
+	}
+	default:
+		return 0;
+	}
+}
+
+void
+Batcher::add_handlers()
+{
+	add_read_handler("pool_size", read_handler, h_pool_size);
+	add_read_handler("pool_in_use", read_handler, h_pool_in_use);
+	add_read_handler("pool_misses", read_handler, h_pool_misses);
+	add_read_handler("pool_high_water", read_handler, h_pool_high_water);
+	add_read_handler("pool_thread_stats", read_handler, h_pool_thread_stats);
+	add_read_handler("batch_size", read_handler, h_batch_size);
+	add_read_handler("timeout_us", read_handler, h_timeout_us);
+	add_read_handler("fill_ratio", read_handler, h_fill_ratio);
+	add_read_handler("flush_full", read_handler, h_flush_full);
+	add_read_handler("flush_timeout", read_handler, h_flush_timeout);
+	add_read_handler("flush_idle", read_handler, h_flush_idle);
+	add_read_handler("flush_region", read_handler, h_flush_region);
+	add_read_handler("arrival_rate", read_handler, h_arrival_rate);
+	add_read_handler("completion_latency", read_handler, h_completion_latency);
+	add_read_handler("zc_misses", read_handler, h_zc_misses);
+	add_read_handler("stages", read_handler, h_stages);
+	add_write_handler("trace_reset", write_handler, h_trace_reset, Handler::BUTTON);
+	add_write_handler("trace_dump", write_handler, h_trace_dump);
+}
+
 void
 Batcher::run_timer(Timer *timer)
 {
@@ -188,7 +831,33 @@ Batcher::run_timer(Timer *timer)
 	alloc_batch();
 	if (_test)
 		hvp_chatter("batch %p(%d) timeout at %s\n", pb, pb->size(), Timestamp::now().unparse().c_str());
-	output(0).bpush(pb);
+	flush_batch(pb, flush_timeout);
+}
+
+/*
+ * Woken by an upstream idle notifier: the source's last burst came back
+ * short, so don't hold the partial batch any longer.
+ */
+bool
+Batcher::run_task(Task *task)
+{
+	return flush_idle_batch();
+}
+
+bool
+Batcher::flush_idle_batch()
+{
+	if (!_batch || _batch->size() == 0)
+		return false;
+
+	if (_timer.scheduled())
+		_timer.clear();
+	PBatch *pb = _batch;
+	alloc_batch();
+	if (_test)
+		hvp_chatter("batch %p(%d) idle flush at %s\n", pb, pb->size(), Timestamp::now().unparse().c_str());
+	flush_batch(pb, flush_idle);
+	return true;
 }
 
 void
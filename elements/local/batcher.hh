@@ -7,19 +7,141 @@
 #include <g4c.h>
 #include <click/task.hh>
 #include <click/timer.hh>
+#include <click/atomic.hh>
+#include <click/sync.hh>
+#include <click/ewma.hh>
+#include <click/notifier.hh>
+#include <click/hvputils.hh>
 CLICK_DECLS
 
 #define CLICK_BATCH_TIMEOUT 2000
 
+class Batcher;
+
+/**
+ * Free list of preallocated PBatches owned by one Batcher.
+ *
+ * Every batch in the pool has the same geometry (capacity, slice range,
+ * annotation and user private data sizes), so its page-locked host memory,
+ * device memory and user_priv can be reused as is. There is one free list
+ * per RouterThread: a batch killed on some thread goes back to that
+ * thread's list, and the owning Batcher takes a whole list from another
+ * thread when its own runs dry, so the lock is mostly uncontended.
+ *
+ * The pool outlives its Batcher while batches are still in flight; the
+ * last returning batch frees it. detach() marks each free list detached
+ * under that list's lock, and put() checks the mark under the same lock,
+ * so a batch is either pushed to a live free list or freed, never both.
+ * detach() counts itself in _in_use while it walks the lists, so no put()
+ * frees the pool under it.
+ */
+class PBatchPool {
+public:
+	PBatchPool(int nlists);
+	~PBatchPool();
+
+	PBatch *get();
+	void put(PBatch *pb);
+	void add(PBatch *pb);
+	void adopt(PBatch *pb);
+	void detach();
+
+	inline int size() const { return _size; }
+	inline uint32_t in_use() const { return _in_use.value(); }
+	inline uint32_t misses() const { return _misses; }
+	inline uint32_t high_water() const { return _high_water; }
+	String thread_stats() const;
+
+private:
+	struct freelist {
+		SimpleSpinlock lock;
+		PBatch *head;
+		uint32_t gets;
+		uint32_t puts;
+		uint32_t steals;
+		uint32_t misses;
+		bool detached;
+		freelist() : head(0), gets(0), puts(0), steals(0), misses(0),
+			     detached(false) {}
+	};
+
+	freelist *_lists;
+	int _nlists;
+	int _size;
+	atomic_uint32_t _in_use;
+	uint32_t _misses;
+	uint32_t _high_water;
+
+	inline int current_list() const;
+	inline void note_get();
+	void push_list(int i, PBatch *chain);
+	PBatch *take_list(int i);
+};
+
 /**
  * Batcher configurations:
  *   TIMEOUT: int value in mili-sec.
+ *   FLUSH_TIMEOUT: time value, overrides TIMEOUT for sub-millisecond
+ *                  deadlines, e.g. "50us".
+ *   FLUSH_ON_IDLE: bool value. Push the partial batch as soon as an
+ *                  upstream source with an idle notifier (FromDevice)
+ *                  reports a short burst, instead of waiting for the
+ *                  timeout.
  *   SLICE_BEGIN: int value
  *   SLICE_END: int value
  *   CAPACITY: int value for batch capacity
  *   ANN_FLAGS: unsigned char.
+ *   FIELDS: unsigned char, PBATCH_FIELD_* flags of header fields to parse
+ *           into columns at batching time, besides those users request
+ *           with set_fields().
  *   FORCE_PKTLENS: bool value.
- *   
+ *   POOL_SIZE: int value, number of batches preallocated at initialize
+ *              time and recycled by kill_batch. 0 disables the pool.
+ *   ZERO_COPY: bool value. Build zero-copy batches that carry slice
+ *              offsets into a registered PBatchRegion, e.g. the netmap
+ *              memory, instead of copied slices. Packets outside any
+ *              registered region are dropped and counted in zc_misses.
+ *              Only netmap registers a region, so this needs a build
+ *              with netmap, and BatchFromDevice with METHOD NETMAP as
+ *              the producer.
+ *   ADAPTIVE: bool value. Choose the batch size and flush deadline from
+ *             the packet arrival rate and the completion latency reported
+ *             by PushBatchQueue (see its BATCHER keyword), so that the
+ *             first packet of a batch completes within LATENCY_SLO.
+ *             CAPACITY is the upper bound of the batch size, TIMEOUT is
+ *             ignored.
+ *   LATENCY_SLO: time value with usec precision, default 1ms.
+ *   MIN_BATCH: int value, lower bound of the adaptive batch size.
+ *   TRACE: bool value. Stamp batches at each lifecycle point, see
+ *          PBATCH_TS_FIRST, for the stages handler.
+ *   TRACE_RING: int value, also keep the stamps of the last TRACE_RING
+ *               batches for trace_dump. Implies TRACE.
+ *   TRACE_FILE: filename, where cleanup dumps the ring.
+ *
+ * Handlers:
+ *   pool_size: batches owned by the pool, preallocated plus grown on misses.
+ *   pool_in_use: batches currently handed out.
+ *   pool_misses: allocations that found every free list empty.
+ *   pool_high_water: maximum pool_in_use seen.
+ *   pool_thread_stats: one line per thread free list, "THREAD GETS PUTS
+ *     STEALS MISSES": batches taken from and returned to that list, whole
+ *     lists taken from other threads, and misses, while the owner ran on
+ *     that thread.
+ *   batch_size: current flush size, CAPACITY unless ADAPTIVE.
+ *   timeout_us: current flush deadline in usec.
+ *   fill_ratio: average batch fill in percent of CAPACITY.
+ *   flush_full, flush_timeout, flush_idle: batches flushed on size, on
+ *     deadline and on upstream idleness.
+ *   flush_region: zero-copy batches flushed early because a packet came
+ *     from another region.
+ *   arrival_rate: average packet arrival rate in packets/sec (ADAPTIVE).
+ *   completion_latency: average queue-to-completion usec (ADAPTIVE).
+ *   zc_misses: packets dropped by ZERO_COPY for being outside any region.
+ *   stages: with TRACE, one line per batch stage with its count and
+ *           p50, p99, p999 and max in cycles, see PBatchTrace.
+ *   trace_reset: write handler, clears the stages and the ring.
+ *   trace_dump: write handler, dumps the ring to the file given, or
+ *               TRACE_FILE.
  */
 class Batcher : public Element {
 public:
@@ -33,23 +155,40 @@ public:
 	void push(int i, Packet *p);
 	int configure(Vector<String> &conf, ErrorHandler *errh);
 	int initialize(ErrorHandler *errh);
+	void cleanup(CleanupStage stage);
+	void add_handlers();
 
 	void run_timer(Timer *timer);
+	bool run_task(Task *task);
 
 	// Batcher/PBatch users are supposed to call the followings at their
 	// configuration time.
 	void set_slice_range(int begin, int end);
 	void set_anno_flags(unsigned char flags);
+	// Fields instead of, or besides, a slice range; see PBatchFields.
+	inline void set_fields(unsigned char flags) { _field_flags |= flags; }
+	inline void set_force_pktlens() { _force_pktlens = true; }
+	inline bool zero_copy() const { return _zero_copy; }
 	inline unsigned long set_batch_user_info(unsigned long priv_len)
 		{
 			unsigned long cur = _user_priv_len;
-			
+
 			_nr_users++;
 			_user_priv_len += g4c_round_up(priv_len, 8); // for 64bit/8byte alignment.
 			return cur;
 		}
 
 	static bool kill_batch(PBatch *pb);
+	static void destroy_batch(PBatch *pb);
+
+	// Completion feedback for adaptive batching.
+	void batch_completed(PBatch *pb);
+
+protected:
+	// For subclasses that batch packets they make themselves, such as
+	// BatchFromDevice, without a push() in between.
+	inline void batch_packet(Packet *p);
+	bool flush_idle_batch();
 
 private:
 	int _batch_capacity;
@@ -58,23 +197,94 @@ private:
 	PBatch *_batch;
 	int _slice_begin, _slice_end;
 	unsigned char _anno_flags;
+	unsigned char _field_flags;
 	bool _force_pktlens;
 
 	int _nr_users;
 	unsigned long _user_priv_len;
 
 	int _timeout_ms;
+	Timestamp _timeout;
 	Timer _timer;
 	PBatch *_timed_batch;
 
+	bool _flush_on_idle;
+	Task _idle_task;
+
+	bool _zero_copy;
+	const PBatchRegion *_region;	// last region hit
+	unsigned _region_gen;		// its gen when it was hit
+	uint32_t _zc_misses;
+
+	int _pool_size;
+	PBatchPool *_pool;
+
+	PBatchTrace *_trace;
+	uint32_t _trace_ring;
+	String _trace_file;
+
+	typedef DirectEWMAX<FixedEWMAXParameters<3, 10, uint64_t, int64_t> > ewma_type;
+
+	bool _adaptive;
+	uint32_t _slo_us;
+	int _min_batch;
+	int _target_size;
+	uint32_t _deadline_us;
+	Timestamp _last_flush;
+	ewma_type _rate;	// packets/sec
+	ewma_type _latency;	// usec
+	ewma_type _fill;	// percent of capacity
+	uint32_t _flush_full;
+	uint32_t _flush_timeout;
+	uint32_t _flush_idle;
+	uint32_t _flush_region;
+
 	int _count;
 	int _drops;
 	bool _test;
 
+	PBatch *create_batch();
 	PBatch *alloc_batch();
 	void add_packet(Packet *p);
+	bool add_packet_zero_copy(Packet *p);
+	enum { flush_full, flush_timeout, flush_idle, flush_region };
+	void flush_batch(PBatch *pb, int reason);
+	void adapt();
+
+	static void free_batch(PBatch *pb);
+#if CLICK_DEBUG_PBATCH
+	static void check_leaks(Router *router, void *user_data);
+#endif
 
+	static String read_handler(Element *e, void *thunk);
+	static int write_handler(const String &str, Element *e, void *thunk,
+				 ErrorHandler *errh);
 };
 
+/**
+ * Add p to the current batch, and push the batch out when it is full.
+ */
+inline void
+Batcher::batch_packet(Packet *p)
+{
+	if (!_batch)
+		alloc_batch();
+
+	add_packet(p);
+	_count++;
+
+	if (_batch->size() >= _target_size) {
+		if (_test) {
+			hvp_chatter("batch %p full at %s\n", _batch,
+				    Timestamp::now().unparse().c_str());
+		}
+		if (_timer.scheduled())
+			_timer.clear();
+		PBatch *oldbatch = _batch;
+		alloc_batch();
+		flush_batch(oldbatch, flush_full);
+	}
+}
+
 CLICK_ENDDECLS
 #endif
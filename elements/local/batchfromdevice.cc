@@ -0,0 +1,331 @@
+#include <click/config.h>
+#include "batchfromdevice.hh"
+#include <click/error.hh>
+#include <click/confparse.hh>
+#include <click/packet_anno.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <click/router.hh>
+#include <click/master.hh>
+#include <unistd.h>
+#if HAVE_NET_NETMAP_H
+# include <sys/ioctl.h>
+#endif
+#if FROMDEVICE_LINUX
+# include <sys/socket.h>
+# include <netpacket/packet.h>
+#endif
+CLICK_DECLS
+
+BatchFromDevice::BatchFromDevice() : _fd(-1), _burst(32), _queue(-1),
+				     _extra_buffers(1024),
+				     _promisc(false),
+				     _snaplen(FromDevice::default_snaplen),
+				     _idle_flush(false), _task(this),
+				     _rx_count(0), _complaints(0)
+{
+#if FROMDEVICE_LINUX
+	_was_promisc = -1;
+#endif
+#if FROMDEVICE_PCAP
+	_pcap = 0;
+#endif
+	_headroom = Packet::default_headroom;
+	_headroom += (4 - (_headroom + 2) % 4) % 4;
+}
+
+BatchFromDevice::~BatchFromDevice()
+{
+}
+
+int
+BatchFromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+	String method;
+	int thread = -1;
+
+	if (cp_va_kparse_remove_keywords(conf, this, errh,
+					 "DEVNAME", cpkM, cpString, &_ifname,
+					 "METHOD", 0, cpWord, &method,
+					 "BURST", 0, cpInteger, &_burst,
+					 "PROMISC", 0, cpBool, &_promisc,
+					 "SNAPLEN", 0, cpInteger, &_snaplen,
+					 "HEADROOM", 0, cpUnsigned, &_headroom,
+					 "FLUSH_ON_IDLE", 0, cpBool, &_idle_flush,
+					 "QUEUE", 0, cpInteger, &_queue,
+					 "EXTRA_BUFFERS", 0, cpUnsigned, &_extra_buffers,
+					 "THREAD", 0, cpInteger, &thread,
+					 cpEnd) < 0)
+		return -1;
+	if (_burst <= 0)
+		return errh->error("BURST out of range");
+	if (_snaplen > 8190 || _snaplen < 14)
+		return errh->error("SNAPLEN out of range");
+#if !HAVE_NET_NETMAP_H
+	if (_queue >= 0)
+		return errh->error("QUEUE requires netmap");
+#endif
+	if (thread >= master()->nthreads())
+		return errh->error("THREAD %d out of range, there are %d threads",
+				   thread, master()->nthreads());
+	if (thread >= 0)
+		router()->set_home_thread_id(this, thread);
+
+	if (!method) {
+#if HAVE_NET_NETMAP_H
+		_method = method_netmap;
+#elif FROMDEVICE_LINUX
+		_method = method_linux;
+#elif FROMDEVICE_PCAP
+		_method = method_pcap;
+#else
+		return errh->error("cannot receive packets on this platform");
+#endif
+	}
+#if HAVE_NET_NETMAP_H
+	else if (method == "NETMAP")
+		_method = method_netmap;
+#endif
+#if FROMDEVICE_LINUX
+	else if (method == "LINUX")
+		_method = method_linux;
+#endif
+#if FROMDEVICE_PCAP
+	else if (method == "PCAP")
+		_method = method_pcap;
+#endif
+	else
+		return errh->error("bad METHOD");
+	if (_queue >= 0 && _method != method_netmap)
+		return errh->error("QUEUE requires METHOD NETMAP");
+
+	return Batcher::configure(conf, errh);
+}
+
+int
+BatchFromDevice::initialize(ErrorHandler *errh)
+{
+	if (Batcher::initialize(errh) < 0)
+		return -1;
+
+#if HAVE_NET_NETMAP_H
+	if (_method == method_netmap) {
+		_fd = _netmap.open(_ifname, true, errh, _queue, _extra_buffers);
+		if (_fd < 0)
+			return -1;
+		_netmap.initialize_rings_rx(-1);
+	}
+#endif
+#if FROMDEVICE_PCAP
+	if (_method == method_pcap) {
+		_pcap = FromDevice::open_pcap(_ifname, _snaplen, _promisc, errh);
+		if (!_pcap)
+			return -1;
+		_fd = pcap_fileno(_pcap);
+	}
+#endif
+#if FROMDEVICE_LINUX
+	if (_method == method_linux) {
+		_fd = FromDevice::open_packet_socket(_ifname, errh);
+		if (_fd < 0)
+			return -1;
+		_was_promisc = FromDevice::set_promiscuous(_fd, _ifname, _promisc);
+		if (_was_promisc < 0 && _promisc)
+			errh->warning("cannot set promiscuous mode");
+	}
+#endif
+
+	add_select(_fd, SELECT_READ);
+	ScheduleInfo::initialize_task(this, &_task, false, errh);
+	return 0;
+}
+
+void
+BatchFromDevice::cleanup(CleanupStage stage)
+{
+	Batcher::cleanup(stage);
+#if HAVE_NET_NETMAP_H
+	if (_method == method_netmap && _fd >= 0)
+		_netmap.close(_fd);
+#endif
+#if FROMDEVICE_PCAP
+	if (_pcap)
+		pcap_close(_pcap);
+	_pcap = 0;
+#endif
+#if FROMDEVICE_LINUX
+	if (_method == method_linux && _fd >= 0) {
+		if (_was_promisc >= 0)
+			FromDevice::set_promiscuous(_fd, _ifname, _was_promisc);
+		close(_fd);
+	}
+#endif
+	_fd = -1;
+}
+
+#if HAVE_NET_NETMAP_H
+/*
+ * Batch up to BURST packets from the RX rings, then give the slots back
+ * with one sync. A packet takes its slot's buffer when there is a free
+ * one to put in the slot instead, and is copied otherwise. Zero-copy
+ * batches must keep pointing at netmap memory until they are killed, so
+ * with ZERO_COPY nothing is copied: the burst stops when no buffer is
+ * free, and the slot waits in the ring until a batch gives one back.
+ */
+int
+BatchFromDevice::netmap_dispatch()
+{
+	int n = 0;
+
+	for (unsigned ri = _netmap.ring_begin; ri != _netmap.ring_end && n < _burst; ++ri) {
+		struct netmap_ring *ring = NETMAP_RXRING(_netmap.nifp, ri);
+
+		while (n < _burst && !nm_ring_empty(ring)) {
+			unsigned cur = ring->cur;
+			unsigned char *buf = (unsigned char *) NETMAP_BUF(ring, ring->slot[cur].buf_idx);
+			unsigned len = ring->slot[cur].len;
+
+			WritablePacket *p;
+			if (NetmapInfo::refill(ring))
+				p = Packet::make(buf, len, NetmapInfo::buffer_destructor);
+			else if (zero_copy())
+				goto out;
+			else
+				p = Packet::make(_headroom, buf, len, 0);
+			ring->head = ring->cur = nm_ring_next(ring, cur);
+
+			if (p) {
+				p->set_mac_header(p->data());
+				batch_packet(p);
+				n++;
+			}
+		}
+	}
+
+ out:
+	if (n)
+		ioctl(_fd, NIOCRXSYNC, 0);
+	return n;
+}
+#endif
+
+#if FROMDEVICE_LINUX
+/*
+ * Read up to BURST packets from the packet socket, one recvfrom each,
+ * skipping the packets this host sends.
+ */
+int
+BatchFromDevice::linux_dispatch()
+{
+	int n = 0;
+
+	while (n < _burst) {
+		WritablePacket *p = Packet::make(_headroom, 0, _snaplen, 0);
+		if (!p)
+			break;
+		struct sockaddr_ll sa;
+		socklen_t fromlen = sizeof(sa);
+		int len = recvfrom(_fd, p->data(), p->length(), MSG_TRUNC,
+				   (struct sockaddr *) &sa, &fromlen);
+		if (len <= 0) {
+			p->kill();
+			if (len < 0 && errno != EAGAIN && ++_complaints < 5)
+				ErrorHandler::default_handler()->error("%{element}: recvfrom: %s", this, strerror(errno));
+			break;
+		}
+		if (sa.sll_pkttype == PACKET_OUTGOING) {
+			p->kill();
+			continue;
+		}
+
+		if (len > _snaplen)
+			SET_EXTRA_LENGTH_ANNO(p, len - _snaplen);
+		else
+			p->take(_snaplen - len);
+		p->set_packet_type_anno((Packet::PacketType) sa.sll_pkttype);
+		p->set_mac_header(p->data());
+		batch_packet(p);
+		n++;
+	}
+	return n;
+}
+#endif
+
+#if FROMDEVICE_PCAP
+void
+BatchFromDevice::pcap_packet(u_char *arg, const struct pcap_pkthdr *h,
+			     const u_char *data)
+{
+	BatchFromDevice *bf = (BatchFromDevice *) arg;
+	WritablePacket *p = Packet::make(bf->_headroom, data, h->caplen, 0);
+
+	if (p) {
+		p->set_timestamp_anno(Timestamp::make_usec(h->ts.tv_sec, h->ts.tv_usec));
+		p->set_mac_header(p->data());
+		SET_EXTRA_LENGTH_ANNO(p, h->len - h->caplen);
+		bf->batch_packet(p);
+	}
+}
+#endif
+
+/*
+ * Read one burst into the current batch. A short burst means the device
+ * ran dry, so with FLUSH_ON_IDLE the partial batch goes out right away.
+ */
+int
+BatchFromDevice::rx_burst()
+{
+	int n = 0;
+
+#if HAVE_NET_NETMAP_H
+	if (_method == method_netmap)
+		n = netmap_dispatch();
+#endif
+#if FROMDEVICE_LINUX
+	if (_method == method_linux)
+		n = linux_dispatch();
+#endif
+#if FROMDEVICE_PCAP
+	if (_method == method_pcap) {
+		n = pcap_dispatch(_pcap, _burst, pcap_packet, (u_char *) this);
+		if (n < 0) {
+			if (++_complaints < 5)
+				ErrorHandler::default_handler()->error("%{element}: %s", this, pcap_geterr(_pcap));
+			n = 0;
+		}
+	}
+#endif
+
+	_rx_count += n;
+	if (n < _burst && _idle_flush)
+		flush_idle_batch();
+	return n;
+}
+
+void
+BatchFromDevice::selected(int fd, int mask)
+{
+	if (rx_burst() == _burst)
+		_task.reschedule();
+}
+
+bool
+BatchFromDevice::run_task(Task *task)
+{
+	int n = rx_burst();
+	task->charge(n);
+	if (n == _burst)
+		_task.fast_reschedule();
+	return n > 0;
+}
+
+void
+BatchFromDevice::add_handlers()
+{
+	Batcher::add_handlers();
+	add_data_handlers("count", Handler::OP_READ, &_rx_count);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel FromDevice NetmapInfo Batcher)
+EXPORT_ELEMENT(BatchFromDevice)
+ELEMENT_LIBS(-lg4c)
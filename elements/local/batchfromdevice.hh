@@ -0,0 +1,107 @@
+#ifndef CLICK_BATCHFROMDEVICE_HH
+#define CLICK_BATCHFROMDEVICE_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include "elements/userlevel/fromdevice.hh"
+#include "elements/userlevel/netmapinfo.hh"
+#include "batcher.hh"
+CLICK_DECLS
+
+/**
+ * FromDevice that pushes batches.
+ *
+ * A Batcher that reads its packets from a device itself, instead of
+ * having a FromDevice push them in one at a time. Each burst read from
+ * the device goes straight into the current batch: slice or zero-copy
+ * offset, length, annotations and fields, exactly as Batcher does, so
+ * batches out of BatchFromDevice are the same as those of
+ * FromDevice -> Batcher without the extra element and call per packet.
+ *
+ * With METHOD NETMAP, packets are read from the netmap RX rings. While
+ * there are free netmap buffers, a packet keeps the slot's buffer and
+ * the slot gets a free one, so nothing is copied before batching, and
+ * ZERO_COPY batches refer to the netmap memory directly; BatchToDevice
+ * can then hand the buffers to the TX rings. With ZERO_COPY a packet is
+ * never copied, so each keeps its buffer until its batch is killed, and
+ * reading stops while no buffer is free. METHOD LINUX reads packets
+ * from a Linux packet socket and METHOD PCAP with pcap_dispatch; both
+ * copy every packet.
+ *
+ * Configurations:
+ *   DEVNAME: string, the device. Required.
+ *   METHOD: NETMAP, LINUX or PCAP, default NETMAP if available, then
+ *           LINUX.
+ *   BURST: int value, packets read per scheduling, default 32.
+ *   PROMISC: bool value, LINUX and PCAP only.
+ *   SNAPLEN: int value, LINUX and PCAP only, default 2046.
+ *   HEADROOM: int value, headroom of copied packets.
+ *   FLUSH_ON_IDLE: bool value. Push the partial batch as soon as a burst
+ *                  comes back short.
+ *   QUEUE: int value, NETMAP only. Read this hardware RX ring only, so
+ *          that each queue of a multi-queue NIC, filled by RSS, can have
+ *          its own BatchFromDevice. Default all rings. An error
+ *          without netmap.
+ *   EXTRA_BUFFERS: unsigned, NETMAP only. Buffers to ask netmap for
+ *                  besides the rings' own, to put in the slots of the
+ *                  packets that keep theirs. Default 1024.
+ *   THREAD: int value, the thread that runs this element, overriding any
+ *           thread scheduler. Give the BatchFromDevice and the ToDevice of
+ *           a queue the same one.
+ *   And the Batcher configurations.
+ *
+ * Handlers:
+ *   count: packets read.
+ *   And the Batcher handlers.
+ */
+class BatchFromDevice : public Batcher {
+public:
+	BatchFromDevice();
+	~BatchFromDevice();
+
+	const char *class_name() const { return "BatchFromDevice"; }
+	const char *port_count() const { return PORTS_0_1; }
+	const char *processing() const { return PUSH; }
+
+	int configure(Vector<String> &conf, ErrorHandler *errh);
+	int initialize(ErrorHandler *errh);
+	void cleanup(CleanupStage stage);
+	void add_handlers();
+
+	void selected(int fd, int mask);
+	bool run_task(Task *task);
+
+private:
+	String _ifname;
+	enum { method_netmap, method_linux, method_pcap };
+	int _method;
+	int _fd;
+	int _burst;
+	int _queue;
+	unsigned _extra_buffers;
+	bool _promisc;
+	int _snaplen;
+	unsigned _headroom;
+	bool _idle_flush;
+	Task _task;
+	uint32_t _rx_count;
+	int _complaints;
+
+#if HAVE_NET_NETMAP_H
+	NetmapInfo::ring _netmap;
+	int netmap_dispatch();
+#endif
+#if FROMDEVICE_LINUX
+	int _was_promisc;
+	int linux_dispatch();
+#endif
+#if FROMDEVICE_PCAP
+	pcap_t *_pcap;
+	static void pcap_packet(u_char *arg, const struct pcap_pkthdr *h,
+				const u_char *data);
+#endif
+
+	int rx_burst();
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,211 @@
+#include <click/config.h>
+#include "batchiplookup.hh"
+#include <click/error.hh>
+#include <click/confparse.hh>
+#include <click/straccum.hh>
+#include <clicknet/ip.h>
+#include "batcher.hh"
+CLICK_DECLS
+
+BatchIPLookup::BatchIPLookup() : _batcher(0), _offset(14), _fields(false),
+				 _no_route(0)
+{
+}
+
+BatchIPLookup::~BatchIPLookup()
+{
+}
+
+void *
+BatchIPLookup::cast(const char *name)
+{
+	if (strcmp(name, "BatchKernel") == 0)
+		return static_cast<BatchKernel *>(this);
+	return DirectIPLookup::cast(name);
+}
+
+int
+BatchIPLookup::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+	if (cp_va_kparse_remove_keywords(conf, this, errh,
+					 "BATCHER", cpkM, cpElementCast, "Batcher", &_batcher,
+					 "OFFSET", 0, cpInteger, &_offset,
+					 "FIELDS", 0, cpBool, &_fields,
+					 cpEnd) < 0)
+		return -1;
+
+	if (_fields)
+		_batcher->set_fields(PBATCH_FIELD_DST_IP | PBATCH_FIELD_IHL);
+	else {
+		_batcher->set_slice_range(_offset, _offset + sizeof(click_ip));
+		_batcher->set_force_pktlens();
+	}
+
+	return DirectIPLookup::configure(conf, errh);
+}
+
+/*
+ * Second level and result of packet i, whose first-level entry is e, 0
+ * (the discard port) for a packet without an IP header.
+ */
+inline void
+BatchIPLookup::finish(PBatch *pb, int i, uint32_t dst, uint16_t e)
+{
+	if (pb->dropped(i) || pb->pkt_bad(i))
+		return;
+
+	if (e & CHUNK)
+		e = _t._tbl_24_31[((e & MAX_INDEX) << 8) | (dst & 0xFF)];
+
+	const VirtualPort &vp = _t._vport[e];
+	if (vp.port == DISCARD_PORT) {
+		*pb->hpktflag(i) |= PBATCH_PKT_BAD;
+		_no_route++;
+		return;
+	}
+
+	pb->set_pkt_port(i, vp.port);
+	if (vp.gw)
+		pb->pptrs[i]->set_dst_ip_anno(vp.gw);
+}
+
+#ifdef __AVX2__
+/*
+ * First-level entries of eight host order destinations, in the low 16 bits
+ * of each lane. Each lane reads the aligned 32-bit word holding its entry
+ * and shifts the entry down, so no gather reads past the end of the table,
+ * e.g. for 255.255.255.x.
+ */
+inline __m256i
+BatchIPLookup::gather_entries(__m256i d) const
+{
+	__m256i w = _mm256_i32gather_epi32((const int *)_t._tbl_0_23,
+					   _mm256_srli_epi32(d, 9), 4);
+	// bit 8 of the address picks the high or low half of the word
+	__m256i shift = _mm256_and_si256(_mm256_srli_epi32(d, 4),
+					 _mm256_set1_epi32(16));
+	return _mm256_srlv_epi32(w, shift);
+}
+#endif
+
+/*
+ * Destinations from the slices. The first-level entries are fetched for
+ * short packets too, and ignored.
+ */
+void
+BatchIPLookup::lookup_slices(PBatch *pb)
+{
+	int off = _offset - pb->slice_begin + offsetof(click_ip, ip_dst);
+	int minlen = _offset - pb->slice_begin + sizeof(click_ip);
+	int n = pb->size();
+	int i = 0;
+
+#ifdef __AVX2__
+	if (!pb->zero_copy) {
+		const __m256i vidx = _mm256_mullo_epi32(
+			_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+			_mm256_set1_epi32(pb->slice_size));
+		const __m256i bswap = _mm256_setr_epi8(
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+		const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+		uint32_t dsts[8] CLICK_ALIGNED(32);
+		uint32_t ents[8] CLICK_ALIGNED(32);
+
+		for (; i + 8 <= n; i += 8) {
+			const int *base = (const int *)(pb->hslice(i) + off);
+			__m256i d = _mm256_i32gather_epi32(base, vidx, 1);
+			d = _mm256_shuffle_epi8(d, bswap);
+			__m256i e = gather_entries(d);
+			_mm256_store_si256((__m256i *)dsts, d);
+			_mm256_store_si256((__m256i *)ents, _mm256_and_si256(e, low16));
+			for (int j = 0; j < 8; j++)
+				finish(pb, i + j, dsts[j],
+				       *pb->hpktlen(i + j) >= minlen ? ents[j] : 0);
+		}
+	}
+#endif
+
+	for (; i < n; i++) {
+		uint32_t dst;
+		const unsigned char *h = pb->zero_copy ? pb->hzslice(i) : pb->hslice(i);
+		memcpy(&dst, h + off, sizeof(dst));
+		dst = ntohl(dst);
+		finish(pb, i, dst, *pb->hpktlen(i) >= minlen ? _t._tbl_0_23[dst >> 8] : 0);
+	}
+}
+
+/*
+ * Destinations from the dst_ips column, already in host byte order.
+ */
+void
+BatchIPLookup::lookup_fields(PBatch *pb)
+{
+	const uint32_t *dsts = pb->hfields.dst_ips;
+	const uint8_t *ihls = pb->hfields.ihls;
+	int n = pb->size();
+	int i = 0;
+
+#ifdef __AVX2__
+	const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+	uint32_t ents[8] CLICK_ALIGNED(32);
+
+	for (; i + 8 <= n; i += 8) {
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dsts + i));
+		__m256i e = gather_entries(d);
+		_mm256_store_si256((__m256i *)ents, _mm256_and_si256(e, low16));
+		for (int j = 0; j < 8; j++)
+			finish(pb, i + j, dsts[i + j],
+			       !ihls || ihls[i + j] ? ents[j] : 0);
+	}
+#endif
+
+	for (; i < n; i++)
+		finish(pb, i, dsts[i], !ihls || ihls[i] ? _t._tbl_0_23[dsts[i] >> 8] : 0);
+}
+
+void
+BatchIPLookup::cpu_kernel(PBatch *pb)
+{
+	if (pb->hfields.dst_ips)
+		lookup_fields(pb);
+	else
+		lookup_slices(pb);
+}
+
+void
+BatchIPLookup::bpush(int port, PBatch *pb)
+{
+	cpu_kernel(pb);
+	output_batch(pb);
+}
+
+enum { h_no_route, h_chunks };
+
+String
+BatchIPLookup::read_handler(Element *e, void *thunk)
+{
+	BatchIPLookup *t = static_cast<BatchIPLookup *>(e);
+
+	switch ((intptr_t)thunk) {
+	case h_no_route:
+		return String(t->_no_route);
+	case h_chunks:
+		return String(t->_t._tbl_24_31_size >> 8);
+	default:
+		return String();
+	}
+}
+
+void
+BatchIPLookup::add_handlers()
+{
+	DirectIPLookup::add_handlers();
+	add_read_handler("no_route", read_handler, h_no_route);
+	add_read_handler("chunks", read_handler, h_chunks);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel DirectIPLookup Batcher)
+EXPORT_ELEMENT(BatchIPLookup)
+ELEMENT_LIBS(-lg4c)
@@ -0,0 +1,83 @@
+#ifndef CLICK_BATCHIPLOOKUP_HH
+#define CLICK_BATCHIPLOOKUP_HH
+#include <click/element.hh>
+#include <click/glue.hh>
+#include <click/pbatch.hh>
+#include "../ip/directiplookup.hh"
+#include "batchkernel.hh"
+#ifdef __AVX2__
+# include <immintrin.h>
+#endif
+CLICK_DECLS
+
+class Batcher;
+
+/**
+ * BatchIPLookup looks up the destination addresses of a batch, read from
+ * the IP headers in its slices, in DirectIPLookup's DIR-24-8 table: one
+ * 16-bit entry per /24, and 256-entry chunks for the /24s that have longer
+ * prefixes. With AVX2, eight addresses and their first-level entries are
+ * fetched with gathers. The output port of each packet goes to its batch
+ * flags, and a route's gateway, if any, to its destination IP annotation.
+ * Packets with no route are marked PBATCH_PKT_BAD. bpush splits the batch
+ * by port like the other IPRouteTables. With FIELDS, the addresses come
+ * from the batch's dst_ips column instead, see PBatchFields, and are
+ * loaded eight at a time.
+ *
+ * The AVX2 code is only compiled when the compiler targets AVX2, e.g. with
+ * CXXFLAGS="-O2 -mavx2" in hvpconfigure's environment; otherwise every
+ * packet takes the scalar loop.
+ *
+ * Routes are added and removed in place, as in DirectIPLookup, with the
+ * same limits.
+ *
+ * Configurations:
+ *   BATCHER: element, the Batcher of the batches. Required, the slice
+ *            range or the fields are requested from it.
+ *   OFFSET: int value, offset of the IP header in packet data, default 14.
+ *   FIELDS: bool value, request the dst_ips and ihls columns from BATCHER
+ *           instead of a slice range.
+ *   Other arguments are routes, as for DirectIPLookup.
+ *
+ * Handlers:
+ *   no_route: packets with no route.
+ *   chunks: second-level chunks allocated.
+ *   And the DirectIPLookup handlers.
+ */
+class BatchIPLookup : public DirectIPLookup, public BatchKernel {
+public:
+	BatchIPLookup();
+	~BatchIPLookup();
+
+	const char *class_name() const { return "BatchIPLookup"; }
+	const char *port_count() const { return "1/-"; }
+	const char *processing() const { return PUSH; }
+	void *cast(const char *name);
+
+	int configure(Vector<String> &conf, ErrorHandler *errh);
+	void add_handlers();
+
+	void bpush(int port, PBatch *pb);
+	void cpu_kernel(PBatch *pb);
+
+private:
+	enum { CHUNK = 0x8000, MAX_INDEX = 0x7FFF };
+
+	Batcher *_batcher;
+	int _offset;
+	bool _fields;
+
+	uint32_t _no_route;
+
+	inline void finish(PBatch *pb, int i, uint32_t dst, uint16_t e);
+#ifdef __AVX2__
+	inline __m256i gather_entries(__m256i d) const;
+#endif
+	void lookup_slices(PBatch *pb);
+	void lookup_fields(PBatch *pb);
+
+	static String read_handler(Element *e, void *thunk);
+};
+
+CLICK_ENDDECLS
+#endif
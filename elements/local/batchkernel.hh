@@ -0,0 +1,25 @@
+#ifndef CLICK_BATCHKERNEL_HH
+#define CLICK_BATCHKERNEL_HH
+#include <click/pbatch.hh>
+CLICK_DECLS
+
+/**
+ * A batched kernel that can run on the CPU.
+ *
+ * Kernel elements work on a batch's host memory only: hslices, hpktlens,
+ * hpktannos and hpktflags, never on the Packets, so the same stage can
+ * run on the device from the copied layout. Results go to the packet
+ * flags (PBATCH_PKT_PORT_MASK, PBATCH_PKT_BAD); what flags cannot hold,
+ * such as a route's gateway, is set on the Packets.
+ * Kernel elements answer cast("BatchKernel"), which lets BatchDispatcher
+ * run them on the CPU in place of the device path.
+ */
+class BatchKernel {
+public:
+	virtual ~BatchKernel() {}
+
+	virtual void cpu_kernel(PBatch *pb) = 0;
+};
+
+CLICK_ENDDECLS
+#endif
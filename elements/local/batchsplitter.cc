@@ -0,0 +1,55 @@
+#include <click/config.h>
+#include "batchsplitter.hh"
+#include <click/error.hh>
+#include <click/hvputils.hh>
+#include <click/confparse.hh>
+CLICK_DECLS
+
+BatchSplitter::BatchSplitter() : _drops(0)
+{
+}
+
+BatchSplitter::~BatchSplitter()
+{
+}
+
+int
+BatchSplitter::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+	if (cp_va_kparse(conf, this, errh,
+			 cpEnd) < 0)
+		return -1;
+	return 0;
+}
+
+int
+BatchSplitter::initialize(ErrorHandler *errh)
+{
+	_outs.resize(noutputs());
+	return 0;
+}
+
+void
+BatchSplitter::push(int i, Packet *p)
+{
+	hvp_chatter("Error: BatchSplitter's push should not be called!\n");
+}
+
+void
+BatchSplitter::bpush(int i, PBatch *pb)
+{
+	_drops += pb->split(_outs.begin(), _outs.size());
+	for (int port = 0; port < _outs.size(); port++)
+		if (_outs[port])
+			output(port).bpush(_outs[port]);
+}
+
+void
+BatchSplitter::add_handlers()
+{
+	add_data_handlers("drops", Handler::OP_READ, &_drops);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(BatchSplitter)
+ELEMENT_LIBS(-lg4c)
@@ -0,0 +1,45 @@
+#ifndef CLICK_BATCHSPLITTER_HH
+#define CLICK_BATCHSPLITTER_HH
+#include <click/element.hh>
+#include <click/glue.hh>
+#include <click/pbatch.hh>
+#include <click/vector.hh>
+#include <g4c.h>
+CLICK_DECLS
+
+/**
+ * BatchSplitter fans a batch out by the per-packet output port in its
+ * packet flags, as set by a batched classification or route lookup (see
+ * PBATCH_PKT_PORT_MASK). Each output gets a batch with only its packets;
+ * all but one are sub-batches that refer to the original batch's memory.
+ * The rows are sorted by port first, so that each output's batch copies
+ * only its own rows to and from the device and the batches can be on the
+ * device at the same time, see PBatch::split. Packets for ports beyond
+ * the last output are dropped.
+ *
+ * Handlers:
+ *   drops: packets dropped for having no output.
+ */
+class BatchSplitter : public Element {
+public:
+	BatchSplitter();
+	~BatchSplitter();
+
+	const char *class_name() const { return "BatchSplitter"; }
+	const char *port_count() const { return "1/1-"; }
+	const char *processing() const { return PUSH; }
+
+	void push(int i, Packet *p); // Should never be called.
+	void bpush(int i, PBatch *pb);
+
+	int configure(Vector<String> &conf, ErrorHandler *errh);
+	int initialize(ErrorHandler *errh);
+	void add_handlers();
+
+private:
+	Vector<PBatch*> _outs;
+	uint32_t _drops;
+};
+
+CLICK_ENDDECLS
+#endif
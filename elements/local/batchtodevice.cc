@@ -0,0 +1,88 @@
+#include <click/config.h>
+#include "batchtodevice.hh"
+#include <click/error.hh>
+#include <click/hvputils.hh>
+#include "batcher.hh"
+CLICK_DECLS
+
+BatchToDevice::BatchToDevice() : _batches(0), _drops(0), _syncs(0)
+{
+}
+
+BatchToDevice::~BatchToDevice()
+{
+}
+
+inline void
+BatchToDevice::sent(Packet *p, int r)
+{
+	if (r >= 0)
+		checked_output_push(0, p);
+	else {
+		_drops++;
+		checked_output_push(1, p);
+	}
+}
+
+void
+BatchToDevice::push(int port, Packet *p)
+{
+	int r = send_packet(p);
+	if (r >= 0) {
+		sync_tx();
+		_syncs++;
+	}
+	sent(p, r);
+}
+
+void
+BatchToDevice::bpush(int port, PBatch *pb)
+{
+	int queued = 0;
+
+	for (int i = 0; i < pb->size(); i++) {
+		if (pb->dropped(i))
+			continue;
+		Packet *p = pb->pptrs[i];
+		pb->set_dropped(i);
+		if (pb->pkt_bad(i)) {
+			p->kill();
+			continue;
+		}
+
+		int r = send_packet(p);
+		if (r == -ENOBUFS && queued) {
+			// Rings full: push out what we have and retry once.
+			sync_tx();
+			_syncs++;
+			queued = 0;
+			r = send_packet(p);
+		}
+		if (r >= 0)
+			queued++;
+		sent(p, r);
+	}
+
+	if (queued) {
+		sync_tx();
+		_syncs++;
+	}
+	_batches++;
+
+	pb->trace_debatch();
+	Batcher::kill_batch(pb);
+}
+
+void
+BatchToDevice::add_handlers()
+{
+	ToDevice::add_handlers();
+	add_data_handlers("batches", Handler::OP_READ, &_batches);
+	add_data_handlers("drops", Handler::OP_READ, &_drops);
+	add_data_handlers("syncs", Handler::OP_READ, &_syncs);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel ToDevice Batcher)
+EXPORT_ELEMENT(BatchToDevice)
+ELEMENT_LIBS(-lg4c)
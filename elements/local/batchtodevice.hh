@@ -0,0 +1,53 @@
+#ifndef CLICK_BATCHTODEVICE_HH
+#define CLICK_BATCHTODEVICE_HH
+#include <click/element.hh>
+#include <click/glue.hh>
+#include <click/pbatch.hh>
+#include "elements/userlevel/todevice.hh"
+CLICK_DECLS
+
+/**
+ * ToDevice that takes batches.
+ *
+ * Sends the live packets of each pushed batch in one go, without a
+ * DeBatcher in front. With METHOD NETMAP, the whole batch goes into TX
+ * slots and the rings are synced once per batch; only when the rings fill
+ * up mid-batch are they synced once more to make room. Packets in netmap
+ * buffers are swapped into the slots as ToDevice does. Packets marked
+ * PBATCH_PKT_BAD are killed. Sent packets go to output 0 and packets that
+ * could not be sent to output 1, if they exist, as for ToDevice. Plain
+ * pushed packets are sent one at a time.
+ *
+ * Configurations:
+ *   As ToDevice. BURST is not used.
+ *
+ * Handlers:
+ *   batches: batches sent.
+ *   drops: packets that could not be sent.
+ *   syncs: TX syncs.
+ *   And the ToDevice handlers.
+ */
+class BatchToDevice : public ToDevice {
+public:
+	BatchToDevice();
+	~BatchToDevice();
+
+	const char *class_name() const { return "BatchToDevice"; }
+	const char *port_count() const { return "1/0-2"; }
+	const char *processing() const { return "h/h"; }
+
+	void push(int port, Packet *p);
+	void bpush(int port, PBatch *pb);
+
+	void add_handlers();
+
+private:
+	uint32_t _batches;
+	uint32_t _drops;
+	uint32_t _syncs;
+
+	inline void sent(Packet *p, int r);
+};
+
+CLICK_ENDDECLS
+#endif
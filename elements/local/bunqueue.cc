@@ -14,20 +14,34 @@ BUnqueue::BUnqueue()
 	_que_len = DEFAULT_LEN;
 	_drops = 0;
 	_test = false;
+	_notify = false;
+	_spin = 16;
+	_spins = 0;
 }
 
 BUnqueue::~BUnqueue()
 {
 }
 
+void *
+BUnqueue::cast(const char *name)
+{
+	if (_notify && strcmp(name, Notifier::EMPTY_NOTIFIER) == 0)
+		return static_cast<Notifier *>(&_empty_note);
+	return Element::cast(name);
+}
+
 int
 BUnqueue::configure(Vector<String> &conf, ErrorHandler *errh)
 {
 	if (cp_va_kparse(conf, this, errh,
 			 "LENGTH", cpkN, cpInteger, &_que_len,
 			 "TEST", cpkN, cpBool, &_test,
+			 "NOTIFY", cpkN, cpBool, &_notify,
+			 "SPIN", cpkN, cpInteger, &_spin,
 			 cpEnd) < 0)
 		return -1;
+	_empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
 	return 0;
 }
 
@@ -35,9 +49,18 @@ int
 BUnqueue::initialize(ErrorHandler *errh)
 {
 	_que.reserve(_que_len);
+	if (_notify && _completion.initialize(this, errh) < 0)
+		return -1;
 	return 0;
 }
 
+void
+BUnqueue::selected(int fd, int mask)
+{
+	_completion.drain();
+	_empty_note.wake();
+}
+
 void
 BUnqueue::push(int i, Packet *p)
 {
@@ -55,26 +78,41 @@ void
 BUnqueue::bpush(int i, PBatch *pb)
 {
 	if (!_que.add_new(pb)) {
-		_drops = pb->size();
+		_drops += pb->nrows();
 		Batcher::kill_batch(pb);
-	}
+	} else if (_notify)
+		_empty_note.wake();
 }
 
 PBatch *
 BUnqueue::bpull(int port)
 {
-	if (_que.empty())
+	if (_que.empty()) {
+		if (_notify) {
+			_spins = 0;
+			_empty_note.sleep();
+			// bpush may have come in from another thread.
+			if (!_que.empty())
+				_empty_note.wake();
+		}
 		return 0;
-	else {
+	} else {
 		PBatch *pb = _que.oldest();
 		if (g4c_stream_done(pb->dev_stream)) {
 			_que.remove_oldest();
+			_spins = 0;
 			if (_test)
 				hvp_chatter("batch %p done at %s\n", pb,
 					    Timestamp::now().unparse().c_str());
 			return pb;
-		} else
+		} else {
+			if (_notify && ++_spins >= _spin
+			    && _completion.arm(pb->dev_stream)) {
+				_spins = 0;
+				_empty_note.sleep();
+			}
 			return 0;
+		}
 	}
 }
 
@@ -5,8 +5,23 @@
 #include <click/pbatch.hh>
 #include <g4c.h>
 #include <click/ring.hh>
+#include <click/notifier.hh>
+#include "streamnotify.hh"
 CLICK_DECLS
 
+/**
+ * Queue of batches in flight, pulled in order as their streams complete.
+ *
+ * Configurations:
+ *   LENGTH: int value, queue length, default 65536.
+ *   TEST: bool value, print completions.
+ *   NOTIFY: bool value, default false. Provide an empty notifier, so that
+ *           pulling tasks sleep while the queue is empty, or while the
+ *           oldest batch is still in flight after SPIN pulls and the g4c
+ *           runtime can report its completion, see StreamNotify.
+ *   SPIN: int value, pulls of an unfinished batch before sleeping in
+ *         NOTIFY mode, default 16.
+ */
 class BUnqueue : public Element {
 public:
 	BUnqueue();
@@ -15,6 +30,7 @@ public:
 	const char *class_name() const { return "BUnqueue"; }
 	const char *port_count() const { return PORTS_1_1; }
 	const char *processing() const { return PUSH_TO_PULL; }
+	void *cast(const char *name);
 
 	void push(int i, Packet *p); // Should never be called.
 	void bpush(int i, PBatch *pb);
@@ -24,6 +40,7 @@ public:
 
 	int configure(Vector<String> &conf, ErrorHandler *errh);
 	int initialize(ErrorHandler *errh);
+	void selected(int fd, int mask);
 
 	static const int DEFAULT_LEN;
 
@@ -32,6 +49,12 @@ private:
 	LFRing<PBatch*> _que;
 	int _drops;
 	bool _test;
+
+	bool _notify;
+	int _spin;
+	int _spins;
+	ActiveNotifier _empty_note;
+	StreamNotify _completion;
 };
 
 CLICK_ENDDECLS
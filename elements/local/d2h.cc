@@ -5,7 +5,7 @@
 #include "batcher.hh"
 CLICK_DECLS
 
-D2H::D2H()
+D2H::D2H() : _bytes(0), _full_bytes(0), _copies(0), _batches(0)
 {
 }
 
@@ -22,6 +22,7 @@ D2H::push(int i, Packet *p)
 void
 D2H::bpush(int i, PBatch *pb)
 {
+	pb->stamp(PBATCH_TS_KERNEL);
 	if (pb->work_size == 0 ||
 	    pb->hwork_ptr == 0 ||
 	    pb->dwork_ptr == 0) {
@@ -37,7 +38,20 @@ D2H::bpush(int i, PBatch *pb)
 		}
 	}
 
-	g4c_d2h_async(pb->dwork_ptr, pb->hwork_ptr, pb->work_size, pb->dev_stream);
+	unsigned long offs[PBatch::max_work_ranges], lens[PBatch::max_work_ranges];
+	int n = pb->work_ranges(offs, lens);
+	for (int r = 0; r < n; r++)
+		if (lens[r]) {
+			g4c_d2h_async(g4c_ptr_add(pb->dwork_ptr, offs[r]),
+				      g4c_ptr_add(pb->hwork_ptr, offs[r]), lens[r],
+				      pb->dev_stream);
+			pb->d2h_bytes += lens[r];
+			_bytes += lens[r];
+			_copies++;
+		}
+	_full_bytes += pb->work_size;
+	_batches++;
+	pb->stamp(PBATCH_TS_D2H);
 	output(0).bpush(pb);
 }
 
@@ -53,6 +67,15 @@ D2H::initialize(ErrorHandler *errh)
 	return 0;
 }
 
+void
+D2H::add_handlers()
+{
+	add_data_handlers("bytes", Handler::OP_READ, &_bytes);
+	add_data_handlers("full_bytes", Handler::OP_READ, &_full_bytes);
+	add_data_handlers("copies", Handler::OP_READ, &_copies);
+	add_data_handlers("batches", Handler::OP_READ, &_batches);
+}
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(Batcher)
 EXPORT_ELEMENT(D2H)
@@ -21,6 +21,15 @@ public:
 
 	int configure(Vector<String> &conf, ErrorHandler *errh);
 	int initialize(ErrorHandler *errh);
+	void add_handlers();
+
+private:
+	// Bus utilization: bytes copied, and what copying every work area
+	// whole would have taken.
+	unsigned long long _bytes;
+	unsigned long long _full_bytes;
+	unsigned long long _copies;
+	unsigned long long _batches;
 };
 
 CLICK_ENDDECLS
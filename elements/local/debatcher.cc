@@ -51,12 +51,21 @@ DeBatcher::pull(int port)
 		_idx = 0;
 	}
 
-	Packet *p = _batch->pptrs[_idx++];
-	assert(p);
+	// Skip slots dropped by batch-processing elements.
+	Packet *p;
+	do {
+		p = _batch->pptrs[_idx++];
+		if (p && _batch->pkt_bad(_idx - 1)) {
+			p->kill();
+			p = 0;
+		}
+	} while (!p && _idx < _batch->size());
 
 	if (_idx == _batch->size()) {
-		Batcher::kill_batch(_batch);
+		finish_batch(_batch);
 		_batch = 0;
+		if (!p)
+			goto pull_batch;
 	}
 
 	return p;	
@@ -66,7 +75,19 @@ void
 DeBatcher::bpush(int i, PBatch *pb)
 {
 	for (int j = 0; j < pb->size(); j++)
-		output(0).push(pb->pptrs[j]);
+		if (pb->dropped(j))
+			continue;
+		else if (pb->pkt_bad(j))
+			pb->pptrs[j]->kill();
+		else
+			output(0).push(pb->pptrs[j]);
+	finish_batch(pb);
+}
+
+void
+DeBatcher::finish_batch(PBatch *pb)
+{
+	pb->trace_debatch();
 	Batcher::kill_batch(pb);
 }
 
@@ -27,6 +27,8 @@ public:
 private:
 	PBatch *_batch;
 	int _idx;
+
+	void finish_batch(PBatch *pb);
 };
 
 CLICK_ENDDECLS
@@ -5,7 +5,7 @@
 #include "batcher.hh"
 CLICK_DECLS
 
-H2D::H2D()
+H2D::H2D() : _bytes(0), _full_bytes(0), _copies(0), _batches(0)
 {
 	_clear_pktflags = false;
 }
@@ -38,10 +38,24 @@ H2D::bpush(int i, PBatch *pb)
 		}
 	}
 
-	g4c_h2d_async(pb->hwork_ptr, pb->dwork_ptr, pb->work_size, pb->dev_stream);
+	unsigned long offs[PBatch::max_work_ranges], lens[PBatch::max_work_ranges];
+	int n = pb->work_ranges(offs, lens);
+	for (int r = 0; r < n; r++)
+		if (lens[r]) {
+			g4c_h2d_async(g4c_ptr_add(pb->hwork_ptr, offs[r]),
+				      g4c_ptr_add(pb->dwork_ptr, offs[r]), lens[r],
+				      pb->dev_stream);
+			pb->h2d_bytes += lens[r];
+			_bytes += lens[r];
+			_copies++;
+		}
+	_full_bytes += pb->work_size;
+	_batches++;
 	if (_clear_pktflags)
-		g4c_dev_memset(pb->dpktflags, 0, pb->capacity*sizeof(unsigned int),
+		g4c_dev_memset(pb->dpktflags + pb->row_begin, 0,
+			       (pb->rows_end() - pb->row_begin)*sizeof(unsigned int),
 			       pb->dev_stream);
+	pb->stamp(PBATCH_TS_H2D);
 	output(0).bpush(pb);
 }
 
@@ -67,6 +81,15 @@ H2D::initialize(ErrorHandler *errh)
 	return 0;
 }
 
+void
+H2D::add_handlers()
+{
+	add_data_handlers("bytes", Handler::OP_READ, &_bytes);
+	add_data_handlers("full_bytes", Handler::OP_READ, &_full_bytes);
+	add_data_handlers("copies", Handler::OP_READ, &_copies);
+	add_data_handlers("batches", Handler::OP_READ, &_batches);
+}
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(Batcher)
 EXPORT_ELEMENT(H2D)
@@ -13,7 +13,9 @@ const int PushBatchQueue::DEFAULT_LEN = (int)(1<<16);
 PushBatchQueue::PushBatchQueue() : _task(this), _que_len(DEFAULT_LEN),
 				   _block(false), _process_all(false),
 				   _fast_sched(false), _test(false),
-				   _sched_on_new(false)
+				   _sched_on_new(false), _drops(0), _batcher(0),
+				   _notify(false), _spin(16), _spins(0),
+				   _batches(0), _packets(0)
 {
 }
 
@@ -32,6 +34,9 @@ PushBatchQueue::configure(Vector<String> &conf, ErrorHandler *errh)
 			 "FAST_SCHED", cpkN, cpBool, &_fast_sched,
 			 "TEST", cpkN, cpBool, &_test,
 			 "SCHED_ON_NEW", cpkN, cpBool, &_sched_on_new,
+			 "BATCHER", cpkN, cpElementCast, "Batcher", &_batcher,
+			 "NOTIFY", cpkN, cpBool, &_notify,
+			 "SPIN", cpkN, cpInteger, &_spin,
 			 cpEnd) < 0)
 		return -1;
 	return 0;
@@ -42,6 +47,8 @@ PushBatchQueue::initialize(ErrorHandler *errh)
 {
 	_que.reserve(_que_len);
 	ScheduleInfo::initialize_task(this, &_task, errh);
+	if (_notify && _completion.initialize(this, errh) < 0)
+		return -1;
 	return 0;
 }
 
@@ -55,7 +62,7 @@ void
 PushBatchQueue::bpush(int i, PBatch *pb)
 {
 	if (!_que.add_new(pb)) {
-		_drops += pb->size();
+		_drops += pb->nrows();
 		Batcher::kill_batch(pb);
 		if (_test)
 			hvp_chatter("Batch %p killed\n",
@@ -63,6 +70,31 @@ PushBatchQueue::bpush(int i, PBatch *pb)
 	}
 	else if (_sched_on_new)
 		_task.fast_reschedule();	
+	else if (_notify)
+		_task.reschedule();
+}
+
+/*
+ * NOTIFY mode, nothing completed this time: keep polling the oldest batch
+ * for SPIN runs, then sleep until its stream is done. An empty queue
+ * sleeps right away, bpush wakes the task.
+ */
+void
+PushBatchQueue::sleep_or_spin()
+{
+	if (_que.empty())
+		_spins = 0;
+	else if (++_spins < _spin || !_completion.arm(_que.oldest()->dev_stream))
+		_task.reschedule();
+	else
+		_spins = 0;
+}
+
+void
+PushBatchQueue::selected(int fd, int mask)
+{
+	_completion.drain();
+	_task.reschedule();
 }
 
 bool
@@ -79,22 +111,79 @@ PushBatchQueue::run_task(Task *task)
 
 		if (_block || done) {
 			_que.remove_oldest();
+			pb->stamp(PBATCH_TS_DONE);
+			if (_batcher)
+				_batcher->batch_completed(pb);
+			_batches++;
+			_packets += pb->nrows();
+			task->charge(pb->nrows());
+			if (pb->tflush)
+				_latency.add((Timestamp::now_steady() - pb->tflush).usecval());
 			output(0).bpush(pb);
 			if (_test)
 				hvp_chatter("Batch %p done at %s.\n", pb,
 					    Timestamp::now().unparse().c_str());
+			_spins = 0;
 			if (!_process_all) {
 				if (_fast_sched)
 					_task.fast_reschedule();
+				else if (_notify)
+					_task.reschedule();
 				return true;
 			}
 		} else
 			break;
 	}
-	_task.reschedule();
+	if (_notify)
+		sleep_or_spin();
+	else
+		_task.reschedule();
 	return false;
 }
 
+enum { h_batches, h_packets, h_drops, h_latency };
+
+String
+PushBatchQueue::read_handler(Element *e, void *thunk)
+{
+	PushBatchQueue *q = static_cast<PushBatchQueue *>(e);
+
+	switch ((intptr_t)thunk) {
+	case h_batches:
+		return String(q->_batches);
+	case h_packets:
+		return String(q->_packets);
+	case h_drops:
+		return String(q->_drops);
+	case h_latency:
+		return q->_latency.unparse();
+	default:
+		return String();
+	}
+}
+
+int
+PushBatchQueue::reset_handler(const String &, Element *e, void *,
+			      ErrorHandler *)
+{
+	PushBatchQueue *q = static_cast<PushBatchQueue *>(e);
+
+	q->_batches = q->_packets = 0;
+	q->_drops = 0;
+	q->_latency.clear();
+	return 0;
+}
+
+void
+PushBatchQueue::add_handlers()
+{
+	add_read_handler("batches", read_handler, h_batches);
+	add_read_handler("packets", read_handler, h_packets);
+	add_read_handler("drops", read_handler, h_drops);
+	add_read_handler("latency", read_handler, h_latency);
+	add_write_handler("reset", reset_handler, 0, Handler::BUTTON);
+}
+
 
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(Batcher)
@@ -5,11 +5,33 @@
 #include <click/pbatch.hh>
 #include <click/ring.hh>
 #include <click/task.hh>
+#include <click/hvputils.hh>
 #include <g4c.h>
+#include "streamnotify.hh"
 CLICK_DECLS
 
+class Batcher;
+
 /**
  * Sync device stream.
+ *
+ * BATCHER: element, a Batcher to report queue-to-completion latency to,
+ *          for its ADAPTIVE mode.
+ * NOTIFY: bool value, default false. Rather than polling all the time,
+ *         sleep the task while the queue is empty, and wake it on bpush.
+ *         When the oldest batch is still in flight after SPIN polls,
+ *         sleep until the device reports that its stream is done, if the
+ *         g4c runtime can, see StreamNotify.
+ * SPIN: int value, polls of an unfinished batch before sleeping in NOTIFY
+ *       mode, default 16. Spinning avoids the wakeup latency for batches
+ *       about to complete.
+ *
+ * Handlers:
+ *   batches, packets: completed so far.
+ *   drops: packets of batches killed because the queue was full.
+ *   latency: percentiles of the usec from the Batcher's flush to
+ *            completion, per batch.
+ *   reset: write handler, clears the counters and latencies.
  */
 class PushBatchQueue : public Element {
 public:
@@ -24,9 +46,11 @@ public:
 	void bpush(int i, PBatch *pb);
 
 	bool run_task(Task *task);
+	void selected(int fd, int mask);
 
 	int configure(Vector<String> &conf, ErrorHandler *errh);
 	int initialize(ErrorHandler *errh);
+	void add_handlers();
 
 	static const int DEFAULT_LEN;
 private:
@@ -39,6 +63,22 @@ private:
 	bool _sched_on_new;
 	bool _fast_sched;
 	int _drops;
+	Batcher *_batcher;
+
+	bool _notify;
+	int _spin;
+	int _spins;
+	StreamNotify _completion;
+
+	uint64_t _batches;
+	uint64_t _packets;
+	HVPHistogram _latency;
+
+	void sleep_or_spin();
+
+	static String read_handler(Element *e, void *thunk);
+	static int reset_handler(const String &, Element *e, void *,
+				 ErrorHandler *);
 };
 
 CLICK_ENDDECLS
@@ -0,0 +1,94 @@
+#ifndef CLICK_STREAMNOTIFY_HH
+#define CLICK_STREAMNOTIFY_HH
+#include <click/element.hh>
+#include <click/error.hh>
+#include <g4c.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+CLICK_DECLS
+
+/**
+ * Device completion as a file descriptor event.
+ *
+ * arm() asks the g4c runtime to call back once the work queued on a
+ * stream so far has completed. The callback runs on a runtime thread and
+ * only writes a byte to a pipe, whose read end the element selects on,
+ * so the element's selected() runs in its own router thread and must
+ * call drain(). At most one request is outstanding: while the last one
+ * has not been drained, arm() returns true without a new one. That is
+ * enough for FIFO users, whose oldest batch cannot change before it
+ * completes.
+ *
+ * arm() returns false when the runtime has no stream notifications, see
+ * G4C_HAVE_STREAM_NOTIFY, and the element has to keep polling.
+ *
+ * The destructor syncs the stream of a request still outstanding, which
+ * waits for the callback too, before it closes the pipe.
+ */
+class StreamNotify {
+public:
+	StreamNotify() : _armed(false), _stream(0) {
+		_fds[0] = _fds[1] = -1;
+	}
+	~StreamNotify() {
+		if (_armed)
+			g4c_stream_sync(_stream);
+		if (_fds[0] >= 0) {
+			close(_fds[0]);
+			close(_fds[1]);
+		}
+	}
+
+	int initialize(Element *e, ErrorHandler *errh) {
+		if (pipe(_fds) < 0)
+			return errh->error("pipe: %s", strerror(errno));
+		fcntl(_fds[0], F_SETFL, O_NONBLOCK);
+		fcntl(_fds[1], F_SETFL, O_NONBLOCK);
+		fcntl(_fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(_fds[1], F_SETFD, FD_CLOEXEC);
+		return e->add_select(_fds[0], Element::SELECT_READ);
+	}
+
+	int fd() const {
+		return _fds[0];
+	}
+
+	bool arm(int stream) {
+#ifdef G4C_HAVE_STREAM_NOTIFY
+		if (_armed)
+			return true;
+		if (_fds[0] < 0 || g4c_stream_notify(stream, completed, this) < 0)
+			return false;
+		_armed = true;
+		_stream = stream;
+		return true;
+#else
+		(void) stream;
+		return false;
+#endif
+	}
+
+	void drain() {
+		char buf[64];
+		while (read(_fds[0], buf, sizeof(buf)) > 0)
+			/* nada */;
+		_armed = false;
+	}
+
+private:
+	int _fds[2];
+	bool _armed;
+	int _stream;
+
+	static void completed(int, void *arg) {
+		StreamNotify *n = static_cast<StreamNotify *>(arg);
+		// A full pipe already has a wakeup pending.
+		ssize_t r = write(n->_fds[1], "", 1);
+		(void) r;
+	}
+};
+
+CLICK_ENDDECLS
+#endif
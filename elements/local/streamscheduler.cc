@@ -0,0 +1,348 @@
+#include <click/config.h>
+#include "streamscheduler.hh"
+#include <click/error.hh>
+#include <click/hvputils.hh>
+#include <click/confparse.hh>
+#include <click/straccum.hh>
+#include <click/standard/scheduleinfo.hh>
+#include "batcher.hh"
+CLICK_DECLS
+
+const int StreamScheduler::DEFAULT_LEN = 1024;
+
+StreamScheduler::StreamScheduler() : _task(this), _nr_streams(4), _depth(0),
+				     _reorder(false), _que_len(DEFAULT_LEN),
+				     _batcher(0), _in_flight(0),
+				     _max_in_flight(0), _next_seq(0),
+				     _next_out(0), _drops(0), _latency_us(0)
+{
+}
+
+StreamScheduler::~StreamScheduler()
+{
+}
+
+int
+StreamScheduler::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+	if (cp_va_kparse(conf, this, errh,
+			 "STREAMS", cpkN, cpInteger, &_nr_streams,
+			 "DEPTH", cpkN, cpInteger, &_depth,
+			 "REORDER", cpkN, cpBool, &_reorder,
+			 "LENGTH", cpkN, cpInteger, &_que_len,
+			 "BATCHER", cpkN, cpElementCast, "Batcher", &_batcher,
+			 cpEnd) < 0)
+		return -1;
+
+	if (_nr_streams <= 0)
+		return errh->error("STREAMS must be positive");
+	if (_depth <= 0)
+		_depth = _nr_streams;
+	return 0;
+}
+
+int
+StreamScheduler::initialize(ErrorHandler *errh)
+{
+	_slots.resize(_nr_streams);
+	for (int i = 0; i < _nr_streams; i++) {
+		slot &s = _slots[i];
+		s.stream = g4c_alloc_stream();
+		if (s.stream == 0) {
+			_slots.resize(i);
+			return errh->error("only %d of %d streams available", i, _nr_streams);
+		}
+		s.pb = 0;
+		s.submitted = false;
+		s.seq = 0;
+		s.batches = 0;
+	}
+
+	if (_reorder) {
+		_held.resize(_depth);
+		for (int i = 0; i < _depth; i++) {
+			_held[i].pb = 0;
+			_held[i].ready = false;
+		}
+	}
+
+	if (!_backlog.reserve(_que_len))
+		return errh->error("out of memory");
+	ScheduleInfo::initialize_task(this, &_task, false, errh);
+	_tstart = Timestamp::now_steady();
+	return 0;
+}
+
+void
+StreamScheduler::cleanup(CleanupStage stage)
+{
+	while (!_backlog.empty()) {
+		Batcher::kill_batch(_backlog.oldest());
+		_backlog.remove_oldest();
+	}
+	for (int i = 0; i < _held.size(); i++)
+		if (_held[i].pb) {
+			Batcher::kill_batch(_held[i].pb);
+			_held[i].pb = 0;
+		}
+	for (int i = 0; i < _slots.size(); i++) {
+		slot &s = _slots[i];
+		if (s.pb) {
+			g4c_stream_sync(s.stream);
+			s.pb->stream_owner = 0;
+			s.pb->dev_stream = 0;
+			if (s.submitted)
+				Batcher::kill_batch(s.pb);
+			s.pb = 0;
+		}
+		g4c_free_stream(s.stream);
+	}
+	_slots.clear();
+}
+
+int
+StreamScheduler::find_slot(PBatch *pb)
+{
+	for (int i = 0; i < _slots.size(); i++)
+		if (_slots[i].pb == pb)
+			return i;
+	return -1;
+}
+
+/*
+ * Give pb a free stream and send it to the device, returns false if
+ * DEPTH batches are in flight or every stream is busy.
+ */
+bool
+StreamScheduler::dispatch(PBatch *pb)
+{
+	_lock.acquire();
+	int i = (_in_flight < _depth ? find_slot(0) : -1);
+	if (i < 0) {
+		_lock.release();
+		return false;
+	}
+
+	slot &s = _slots[i];
+	s.pb = pb;
+	s.submitted = false;
+	s.seq = _next_seq++;
+	s.tstart = Timestamp::now_steady();
+	if (_reorder) {
+		_held[s.seq % _depth].pb = 0;
+		_held[s.seq % _depth].ready = false;
+	}
+
+	if (++_in_flight > _max_in_flight)
+		_max_in_flight = _in_flight;
+
+	pb->dev_stream = s.stream;
+	pb->stream_owner = this;
+	_lock.release();
+	output(0).bpush(pb);
+	return true;
+}
+
+void
+StreamScheduler::emit(PBatch *pb)
+{
+	if (_batcher)
+		_batcher->batch_completed(pb);
+	output(1).bpush(pb);
+}
+
+/*
+ * The stream of s is done: free it and return the batch to push out, or
+ * hold the batch until the ones dispatched before it are out and return
+ * 0. Called with _lock held.
+ */
+PBatch *
+StreamScheduler::complete(slot &s)
+{
+	PBatch *pb = s.pb;
+	Timestamp t = Timestamp::now_steady() - s.tstart;
+
+	s.busy += t;
+	_latency_us = (_latency_us * 7 + (uint32_t)t.usecval()) / 8;
+	s.batches++;
+	s.pb = 0;
+	pb->stream_owner = 0;
+	pb->dev_stream = 0;
+	pb->stamp(PBATCH_TS_DONE);
+
+	if (_reorder) {
+		_held[s.seq % _depth].pb = pb;
+		_held[s.seq % _depth].ready = true;
+		return 0;
+	} else {
+		_in_flight--;
+		return pb;
+	}
+}
+
+void
+StreamScheduler::drain_held()
+{
+	while (_next_out != _next_seq) {
+		held &h = _held[_next_out % _depth];
+		if (!h.ready)
+			break;
+
+		PBatch *pb = h.pb;
+		h.pb = 0;
+		h.ready = false;
+		_next_out++;
+		_in_flight--;
+		if (pb)
+			_done.push_back(pb);
+	}
+}
+
+/*
+ * Called by Batcher::kill_batch, on any thread, for a batch killed before
+ * it completed. Copies and kernels already queued on the stream may still
+ * use the batch's memory, so wait for them before the memory goes back to
+ * the pool.
+ */
+void
+StreamScheduler::stream_released(PBatch *pb)
+{
+	if (pb->dev_stream)
+		g4c_stream_sync(pb->dev_stream);
+
+	_lock.acquire();
+	int i = find_slot(pb);
+	if (i < 0) {
+		_lock.release();
+		return;
+	}
+
+	slot &s = _slots[i];
+	s.busy += Timestamp::now_steady() - s.tstart;
+	s.pb = 0;
+	if (_reorder)
+		_held[s.seq % _depth].ready = true;
+	else
+		_in_flight--;
+	_lock.release();
+	_task.reschedule();
+}
+
+void
+StreamScheduler::push(int i, Packet *p)
+{
+	hvp_chatter("Error: StreamScheduler's push should not be called!\n");
+}
+
+void
+StreamScheduler::bpush(int i, PBatch *pb)
+{
+	if (i == 0) {
+		if (_backlog.empty() && dispatch(pb))
+			return;
+		if (!_backlog.add_new(pb)) {
+			_drops++;
+			Batcher::kill_batch(pb);
+		}
+		return;
+	}
+
+	_lock.acquire();
+	int si = find_slot(pb);
+	if (si >= 0)
+		_slots[si].submitted = true;
+	_lock.release();
+	if (si < 0)
+		// Not dispatched by us, nothing to wait for.
+		emit(pb);
+	else
+		_task.reschedule();
+}
+
+bool
+StreamScheduler::run_task(Task *task)
+{
+	bool worked = false;
+
+	_lock.acquire();
+	for (int i = 0; i < _slots.size(); i++) {
+		slot &s = _slots[i];
+		if (s.pb && s.submitted && g4c_stream_done(s.stream)) {
+			task->charge(s.pb->nrows());
+			if (PBatch *pb = complete(s))
+				_done.push_back(pb);
+			worked = true;
+		}
+	}
+	if (_reorder)
+		drain_held();
+	_lock.release();
+
+	for (int i = 0; i < _done.size(); i++)
+		emit(_done[i]);
+	_done.clear();
+
+	while (!_backlog.empty() && dispatch(_backlog.oldest())) {
+		_backlog.remove_oldest();
+		worked = true;
+	}
+
+	if (_in_flight || !_backlog.empty())
+		_task.fast_reschedule();
+	return worked;
+}
+
+enum { h_in_flight, h_max_in_flight, h_backlog, h_drops, h_streams,
+       h_latency_us };
+
+String
+StreamScheduler::read_handler(Element *e, void *thunk)
+{
+	StreamScheduler *ss = static_cast<StreamScheduler *>(e);
+
+	switch ((intptr_t)thunk) {
+	case h_in_flight:
+		return String(ss->_in_flight);
+	case h_max_in_flight:
+		return String(ss->_max_in_flight);
+	case h_backlog:
+		return String(ss->backlog());
+	case h_drops:
+		return String(ss->_drops);
+	case h_streams: {
+		StringAccum sa;
+		Timestamp now = Timestamp::now_steady();
+		int64_t elapsed = (now - ss->_tstart).usecval();
+		for (int i = 0; i < ss->_slots.size(); i++) {
+			const slot &s = ss->_slots[i];
+			Timestamp busy = s.busy;
+			if (s.pb)
+				busy += now - s.tstart;
+			int util = elapsed > 0 ? (int)(busy.usecval() * 100 / elapsed) : 0;
+			sa << "stream " << s.stream << ": " << s.batches
+			   << " batches, " << util << "% busy\n";
+		}
+		return sa.take_string();
+	}
+	case h_latency_us:
+		return String(ss->_latency_us);
+	default:
+		return String();
+	}
+}
+
+void
+StreamScheduler::add_handlers()
+{
+	add_read_handler("in_flight", read_handler, h_in_flight);
+	add_read_handler("max_in_flight", read_handler, h_max_in_flight);
+	add_read_handler("backlog", read_handler, h_backlog);
+	add_read_handler("drops", read_handler, h_drops);
+	add_read_handler("streams", read_handler, h_streams);
+	add_read_handler("latency_us", read_handler, h_latency_us);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(Batcher)
+EXPORT_ELEMENT(StreamScheduler)
+ELEMENT_LIBS(-lg4c)
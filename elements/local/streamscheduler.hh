@@ -0,0 +1,124 @@
+#ifndef CLICK_STREAMSCHEDULER_HH
+#define CLICK_STREAMSCHEDULER_HH
+#include <click/element.hh>
+#include <click/glue.hh>
+#include <click/pbatch.hh>
+#include <click/ring.hh>
+#include <click/task.hh>
+#include <click/timestamp.hh>
+#include <click/sync.hh>
+#include <g4c.h>
+CLICK_DECLS
+
+class Batcher;
+
+/**
+ * StreamScheduler keeps up to DEPTH batches in flight on a fixed pool of
+ * device streams, and lets them complete out of order.
+ *
+ * Input 0 takes new batches. A batch gets a free stream from the pool and
+ * goes out on output 0, towards H2D, device elements and D2H, whose path
+ * must end in input 1. Batches that find DEPTH batches in flight or no
+ * free stream wait in a backlog. The task polls the streams of the
+ * batches that reached input 1 and pushes each batch on output 1 as soon
+ * as its stream is done, unless REORDER asks for dispatch order. Streams
+ * are taken from GPURuntime once, at initialize time, and reused without
+ * g4c_alloc_stream/g4c_free_stream. A batch killed on the way back still
+ * returns its stream, once the stream has finished with the batch's memory.
+ *
+ * Both inputs and the task are expected to run on one RouterThread. Batches
+ * may be killed on any thread, so the stream slots are kept under a lock,
+ * never held while pushing batches on.
+ *
+ * Configurations:
+ *   STREAMS: int value, size of the stream pool, default 4.
+ *   DEPTH: int value, maximum batches in flight, including completed
+ *          batches held for REORDER. Default STREAMS.
+ *   REORDER: bool value, push completed batches in dispatch order.
+ *   LENGTH: int value, backlog length in batches, default 1024.
+ *   BATCHER: element, a Batcher to report completion latency to.
+ *
+ * Handlers:
+ *   in_flight: batches dispatched and not pushed out yet.
+ *   max_in_flight: maximum in_flight seen.
+ *   backlog: batches waiting for a stream.
+ *   drops: batches killed because the backlog was full.
+ *   streams: one line per stream with its batch count and utilization,
+ *            the busy share of the time since initialize.
+ *   latency_us: moving average of the dispatch to completion time, in
+ *               microseconds.
+ */
+class StreamScheduler : public Element, public PBatchStreamOwner {
+public:
+	StreamScheduler();
+	~StreamScheduler();
+
+	const char *class_name() const { return "StreamScheduler"; }
+	const char *port_count() const { return "2/2"; }
+	const char *processing() const { return PUSH; }
+
+	void push(int i, Packet *p); // Should never be called.
+	void bpush(int i, PBatch *pb);
+
+	bool run_task(Task *task);
+
+	int configure(Vector<String> &conf, ErrorHandler *errh);
+	int initialize(ErrorHandler *errh);
+	void cleanup(CleanupStage stage);
+	void add_handlers();
+
+	void stream_released(PBatch *pb);
+
+	inline uint32_t latency_us() const { return _latency_us; }
+	inline int backlog() const { return _backlog.empty() ? 0 : _backlog.size(); }
+
+	static const int DEFAULT_LEN;
+
+private:
+	struct slot {
+		int stream;
+		PBatch *pb;	// 0 if the stream is free
+		bool submitted;	// pb reached input 1
+		uint32_t seq;
+		Timestamp tstart;
+		uint32_t batches;
+		Timestamp busy;
+	};
+
+	struct held {
+		PBatch *pb;	// 0 for a batch killed in flight
+		bool ready;
+	};
+
+	Vector<slot> _slots;
+	Vector<held> _held;	// REORDER window, indexed by seq % DEPTH
+	Spinlock _lock;		// protects _slots, _held, _in_flight
+	Vector<PBatch *> _done;	// completed batches to push, task only
+	LFRing<PBatch*> _backlog;
+	Task _task;
+
+	int _nr_streams;
+	int _depth;
+	bool _reorder;
+	int _que_len;
+	Batcher *_batcher;
+
+	int _in_flight;
+	int _max_in_flight;
+	uint32_t _next_seq;
+	uint32_t _next_out;
+	uint32_t _drops;
+	uint32_t _latency_us;
+	Timestamp _tstart;
+
+	bool dispatch(PBatch *pb);
+	PBatch *complete(slot &s);
+	void emit(PBatch *pb);
+	void drain_held();
+	int find_slot(PBatch *pb);
+
+	static String read_handler(Element *e, void *thunk);
+};
+
+CLICK_ENDDECLS
+#endif
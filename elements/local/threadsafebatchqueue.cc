@@ -0,0 +1,223 @@
+#include <click/config.h>
+#include "threadsafebatchqueue.hh"
+#include <click/error.hh>
+#include <click/hvputils.hh>
+#include <click/confparse.hh>
+#include "batcher.hh"
+CLICK_DECLS
+
+const int ThreadSafeBatchQueue::DEFAULT_LEN = 1024;
+const int ThreadSafeBatchQueue::DEFAULT_BURST = 32;
+
+/*
+ * Orders slot accesses against batch contents and indexes: a release
+ * before publishing, an acquire after reading. x86 does not reorder loads
+ * with loads or stores with stores, so a compiler barrier is enough there.
+ */
+static inline void
+order_fence()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	click_compiler_fence();
+#else
+	click_fence();
+#endif
+}
+
+ThreadSafeBatchQueue::ThreadSafeBatchQueue()
+	: _head(0), _cache_pos(0), _cache_len(0), _cache(0), _ring(0), _mask(0),
+	  _que_len(DEFAULT_LEN), _burst(DEFAULT_BURST)
+{
+	_tail = 0;
+	_drops = 0;
+}
+
+ThreadSafeBatchQueue::~ThreadSafeBatchQueue()
+{
+	delete[] _ring;
+	delete[] _cache;
+}
+
+void *
+ThreadSafeBatchQueue::cast(const char *name)
+{
+	if (strcmp(name, Notifier::EMPTY_NOTIFIER) == 0)
+		return static_cast<Notifier *>(&_empty_note);
+	else if (strcmp(name, Notifier::FULL_NOTIFIER) == 0)
+		return static_cast<Notifier *>(&_full_note);
+	else
+		return Element::cast(name);
+}
+
+int
+ThreadSafeBatchQueue::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+	if (cp_va_kparse(conf, this, errh,
+			 "LENGTH", cpkN, cpInteger, &_que_len,
+			 "BURST", cpkN, cpInteger, &_burst,
+			 cpEnd) < 0)
+		return -1;
+	if (_que_len <= 0 || _burst <= 0)
+		return errh->error("LENGTH and BURST must be positive");
+
+	_empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+	_full_note.initialize(Notifier::FULL_NOTIFIER, router());
+	_full_note.set_active(true, false);
+	return 0;
+}
+
+int
+ThreadSafeBatchQueue::initialize(ErrorHandler *errh)
+{
+	uint32_t cap = 1;
+	while (cap < (uint32_t)_que_len)
+		cap <<= 1;
+	_mask = cap - 1;
+
+	_ring = new PBatch * volatile[cap];
+	_cache = new PBatch *[_burst];
+	if (!_ring || !_cache)
+		return errh->error("out of memory");
+	for (uint32_t i = 0; i < cap; i++)
+		_ring[i] = 0;
+	return 0;
+}
+
+void
+ThreadSafeBatchQueue::cleanup(CleanupStage stage)
+{
+	while (_cache_pos < _cache_len)
+		Batcher::kill_batch(_cache[_cache_pos++]);
+	if (_ring)
+		for (uint32_t i = 0; i <= _mask; i++)
+			if (_ring[i]) {
+				Batcher::kill_batch(_ring[i]);
+				_ring[i] = 0;
+			}
+}
+
+inline uint32_t
+ThreadSafeBatchQueue::size() const
+{
+	return _tail.value() - _head + (_cache_len - _cache_pos);
+}
+
+void
+ThreadSafeBatchQueue::push(int i, Packet *p)
+{
+	hvp_chatter("Error: ThreadSafeBatchQueue's push should not be called!\n");
+}
+
+void
+ThreadSafeBatchQueue::bpush(int i, PBatch *pb)
+{
+	uint32_t t;
+
+	// Reserve slot t. Reading _head first makes sure the consumer has
+	// emptied the slot.
+	do {
+		t = _tail.value();
+		uint32_t h = _head;
+		order_fence();
+		if (t - h > _mask) {
+			_drops++;
+			_full_note.sleep();
+			// The consumer may have made room and woken us just
+			// before we slept.
+			click_fence();
+			if (_tail.value() - _head <= _mask)
+				_full_note.wake();
+			Batcher::kill_batch(pb);
+			return;
+		}
+	} while (_tail.compare_swap(t, t + 1) != t);
+
+	order_fence();
+	_ring[t & _mask] = pb;
+
+	// Pairs with the fence in bpull(): either it sees the batch, or we
+	// see it asleep.
+	click_fence();
+	_empty_note.wake();
+}
+
+/*
+ * Move up to _burst published batches to the cache. A reserved slot that
+ * is not yet published ends the burst, so batches leave in order.
+ */
+int
+ThreadSafeBatchQueue::dequeue_burst()
+{
+	uint32_t h = _head;
+	int n = 0;
+
+	while (n < _burst) {
+		PBatch * volatile &slot = _ring[(h + n) & _mask];
+		PBatch *pb = slot;
+		if (!pb)
+			break;
+		_cache[n++] = pb;
+		slot = 0;
+	}
+	_cache_pos = 0;
+	_cache_len = n;
+
+	if (n) {
+		order_fence();
+		_head = h + n;
+		_full_note.wake();
+	}
+	return n;
+}
+
+Packet *
+ThreadSafeBatchQueue::pull(int port)
+{
+	hvp_chatter("Error: ThreadSafeBatchQueue's pull should not be called!\n");
+	return 0;
+}
+
+PBatch *
+ThreadSafeBatchQueue::bpull(int port)
+{
+	if (_cache_pos == _cache_len && !dequeue_burst()) {
+		_empty_note.sleep();
+		click_fence();
+		if (_ring[_head & _mask])
+			_empty_note.wake();
+		return 0;
+	}
+	return _cache[_cache_pos++];
+}
+
+enum { h_length, h_capacity, h_drops };
+
+String
+ThreadSafeBatchQueue::read_handler(Element *e, void *thunk)
+{
+	ThreadSafeBatchQueue *q = static_cast<ThreadSafeBatchQueue *>(e);
+
+	switch ((intptr_t)thunk) {
+	case h_length:
+		return String(q->size());
+	case h_capacity:
+		return String(q->_mask + 1);
+	case h_drops:
+		return String(q->_drops.value());
+	default:
+		return String();
+	}
+}
+
+void
+ThreadSafeBatchQueue::add_handlers()
+{
+	add_read_handler("length", read_handler, h_length);
+	add_read_handler("capacity", read_handler, h_capacity);
+	add_read_handler("drops", read_handler, h_drops);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(Batcher)
+EXPORT_ELEMENT(ThreadSafeBatchQueue)
+ELEMENT_LIBS(-lg4c)
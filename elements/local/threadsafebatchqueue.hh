@@ -0,0 +1,89 @@
+#ifndef CLICK_THREADSAFEBATCHQUEUE_HH
+#define CLICK_THREADSAFEBATCHQUEUE_HH
+#include <click/element.hh>
+#include <click/glue.hh>
+#include <click/pbatch.hh>
+#include <click/atomic.hh>
+#include <click/sync.hh>
+#include <click/notifier.hh>
+#include <g4c.h>
+CLICK_DECLS
+
+/**
+ * ThreadSafeBatchQueue hands PBatches from pushing RouterThreads to one
+ * pulling RouterThread, e.g. from several RX cores into the core that
+ * submits to the GPU.
+ *
+ * Producers reserve a slot by compare-and-swap on the tail and publish
+ * the batch with a release store into the slot. The single consumer takes
+ * up to BURST published slots at once and moves the head with one release
+ * store, then hands them out from a private cache. Producer and consumer
+ * indexes live on separate cache lines.
+ *
+ * The queue provides an empty notifier, so that a downstream task sleeps
+ * while there is nothing to pull, and a full notifier for upstream tasks.
+ * A batch pushed into a full queue is killed.
+ *
+ * Configurations:
+ *   LENGTH: int value, queue capacity in batches, rounded up to a power
+ *           of two. Default 1024.
+ *   BURST: int value, batches taken per dequeue. Default 32.
+ *
+ * Handlers:
+ *   length: batches in the queue, including the consumer's cache.
+ *   capacity: LENGTH.
+ *   drops: batches killed because the queue was full.
+ */
+class ThreadSafeBatchQueue : public Element {
+public:
+	ThreadSafeBatchQueue();
+	~ThreadSafeBatchQueue();
+
+	const char *class_name() const { return "ThreadSafeBatchQueue"; }
+	const char *port_count() const { return PORTS_1_1; }
+	const char *processing() const { return PUSH_TO_PULL; }
+	void *cast(const char *name);
+
+	void push(int i, Packet *p); // Should never be called.
+	void bpush(int i, PBatch *pb);
+
+	Packet *pull(int port); // Should never be called.
+	PBatch *bpull(int port);
+
+	int configure(Vector<String> &conf, ErrorHandler *errh);
+	int initialize(ErrorHandler *errh);
+	void cleanup(CleanupStage stage);
+	void add_handlers();
+
+	static const int DEFAULT_LEN;
+	static const int DEFAULT_BURST;
+
+private:
+	enum { cache_line = 64 };
+
+	// Written by producers.
+	atomic_uint32_t _tail CLICK_ALIGNED(cache_line);
+	atomic_uint32_t _drops;
+
+	// Written by the consumer.
+	volatile uint32_t _head CLICK_ALIGNED(cache_line);
+	int _cache_pos;
+	int _cache_len;
+	PBatch **_cache;
+
+	// Read-mostly.
+	PBatch * volatile *_ring CLICK_ALIGNED(cache_line);
+	uint32_t _mask;
+	int _que_len;
+	int _burst;
+	ActiveNotifier _empty_note;
+	ActiveNotifier _full_note;
+
+	inline uint32_t size() const;
+	int dequeue_burst();
+
+	static String read_handler(Element *e, void *thunk);
+};
+
+CLICK_ENDDECLS
+#endif
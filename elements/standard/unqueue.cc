@@ -60,7 +60,7 @@ Unqueue::initialize(ErrorHandler *errh)
 }
 
 bool
-Unqueue::run_task(Task *)
+Unqueue::run_task(Task *task)
 {
     if (!_active)
 	return false;
@@ -85,6 +85,7 @@ Unqueue::run_task(Task *)
 
     _task.fast_reschedule();
   out:
+    task->charge(worked);
     return worked > 0;
 }
 
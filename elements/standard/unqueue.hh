@@ -19,7 +19,9 @@ pull-to-push converter
 Pulls packets whenever they are available, then pushes them out
 its single output. Pulls a maximum of BURST packets every time
 it is scheduled. Default BURST is 1. If BURST
-is less than 0, pull until nothing comes back.
+is less than 0, pull until nothing comes back. Each run is charged for the
+packets it pulls, so BURST does not change Unqueue's share of its thread
+relative to other tasks with equal tickets.
 
 Keyword arguments are:
 
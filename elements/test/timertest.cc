@@ -22,10 +22,11 @@
 #include <click/error.hh>
 #include <click/args.hh>
 #include <click/master.hh>
+#include <click/timerset.hh>
 CLICK_DECLS
 
 TimerTest::TimerTest()
-    : _timer(this), _benchmark(0)
+    : _timer(this), _task(this), _benchmark(0), _compare(false)
 {
 }
 
@@ -37,13 +38,16 @@ int
 TimerTest::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     Timestamp delay;
-    bool schedule = false;
+    bool schedule = false, coarse = false;
     if (Args(conf, this, errh)
 	.read("BENCHMARK", _benchmark)
+	.read("COMPARE", _compare)
 	.read("DELAY", delay)
 	.read("SCHEDULE", schedule)
+	.read("COARSE", coarse)
 	.complete() < 0)
 	return -1;
+    _timer.set_coarse(coarse);
     _timer.initialize(this);
     if (schedule || delay)
 	_timer.schedule_after(delay);
@@ -55,6 +59,8 @@ TimerTest::initialize(ErrorHandler *)
 {
     if (_timer.scheduled())
 	/* do nothing */;
+    else if (_benchmark > 0 && _compare)
+	_task.initialize(this, true);
     else if (_benchmark <= 0) {
 	Timer default_constructor_timer;
 	Timer explicit_do_nothing_timer = Timer::do_nothing_t();
@@ -85,6 +91,20 @@ TimerTest::run_timer(Timer *t)
     click_chatter("%{timestamp}: %{element} fired", &t->expiry_steady(), this);
 }
 
+bool
+TimerTest::run_task(Task *)
+{
+    Timestamp now = Timestamp::now_steady();
+    Timer *ts = new Timer[_benchmark];
+    for (int i = 0; i < _benchmark; ++i) {
+	ts[i].assign();
+	ts[i].initialize(this);
+    }
+    benchmark_compare(ts, _benchmark, now);
+    delete[] ts;
+    return true;
+}
+
 void
 TimerTest::benchmark_schedules(Timer *ts, int nts, const Timestamp &now)
 {
@@ -115,6 +135,42 @@ TimerTest::benchmark_fires(Timer *ts, int, const Timestamp &)
 	t->unschedule();
 }
 
+void
+TimerTest::benchmark_compare(Timer *ts, int nts, const Timestamp &now)
+{
+    RouterThread *th = ts->thread();
+    TimerSet &tset = th->timer_set();
+    for (int coarse = 0; coarse < 2; ++coarse) {
+	for (int i = 0; i < nts; ++i)
+	    ts[i].set_coarse(coarse);
+
+	Timestamp t0 = Timestamp::now_steady();
+	for (int i = 0; i < nts; ++i)
+	    ts[i].schedule_at_steady(now + Timestamp::make_msec(click_random(0, 10000)));
+	Timestamp t1 = Timestamp::now_steady();
+	for (int i = 0; i < 6 * nts; ++i)
+	    ts[click_random(0, nts - 1)].schedule_at_steady(now + Timestamp::make_msec(click_random(0, 10000)));
+	Timestamp t2 = Timestamp::now_steady();
+	for (int i = 0; i < nts; ++i)
+	    ts[i].unschedule();
+	Timestamp t3 = Timestamp::now_steady();
+
+	Timestamp due = Timestamp::now_steady();
+	for (int i = 0; i < nts; ++i)
+	    ts[i].schedule_at_steady(due);
+	Timestamp t4 = Timestamp::now_steady();
+	while (tset.next_timer() || tset.wheel_timer_count())
+	    tset.run_timers(th, master());
+	Timestamp t5 = Timestamp::now_steady();
+
+	Timestamp sched = t1 - t0, resched = t2 - t1, unsched = t3 - t2,
+	    fire = t5 - t4;
+	click_chatter("%{element}: %s, %d timers: schedule %{timestamp}, reschedule %{timestamp}, unschedule %{timestamp}, fire %{timestamp}",
+		      this, coarse ? "wheel" : "heap", nts,
+		      &sched, &resched, &unsched, &fire);
+    }
+}
+
 String
 TimerTest::read_handler(Element *e, void *user_data)
 {
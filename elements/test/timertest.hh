@@ -3,6 +3,7 @@
 #define CLICK_TIMERTEST_HH
 #include <click/element.hh>
 #include <click/timer.hh>
+#include <click/task.hh>
 CLICK_DECLS
 
 /*
@@ -35,12 +36,25 @@ Timestamp. If set, TimerTest schedules a timer starting DELAY seconds in the
 future. On expiry, a message such as "C<1000000000.010000: t1 :: TimerTest fired>"
 is printed to standard error.
 
+=item COARSE
+
+Boolean. If true, TimerTest's timer is a coarse timer, kept in the timing
+wheel rather than the timer heap. Default is false.
+
 =item BENCHMARK
 
 Integer.  If set to a positive number, then TimerTest runs a timer
 manipulation benchmark at installation time involving BENCHMARK total
 timers.  Default is 0 (don't benchmark).
 
+=item COMPARE
+
+Boolean. If true, the BENCHMARK compares the timer heap with the coarse timer
+wheel. It runs the same schedule, reschedule, unschedule, and fire steps
+first with heap timers, then with coarse timers, and prints the time each
+step took. The comparison runs from a task once the router is running, so
+that the timers can actually fire. Default is false.
+
 =back
 
 =h scheduled rw
@@ -73,15 +87,19 @@ class TimerTest : public Element { public:
     void add_handlers();
 
     void run_timer(Timer *t);
+    bool run_task(Task *t);
 
   private:
 
     Timer _timer;
+    Task _task;
     int _benchmark;
+    bool _compare;
 
     void benchmark_schedules(Timer *ts, int nts, const Timestamp &now);
     void benchmark_changes(Timer *ts, int nts, const Timestamp &now);
     void benchmark_fires(Timer *ts, int nts, const Timestamp &now);
+    void benchmark_compare(Timer *ts, int nts, const Timestamp &now);
 
     enum { h_scheduled, h_expiry, h_schedule_after, h_unschedule };
     static String read_handler(Element *e, void *user_data);
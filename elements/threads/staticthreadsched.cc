@@ -38,13 +38,18 @@ StaticThreadSched::configure(Vector<String> &conf, ErrorHandler *errh)
     Element *e;
     int preference;
     for (int i = 0; i < conf.size(); i++) {
+	bool migratable = false;
 	if (Args(this, errh).push_back_words(conf[i])
 	    .read_mp("ELEMENT", e)
 	    .read_mp("THREAD", preference)
+	    .read_p("MIGRATABLE", migratable)
 	    .complete() < 0)
 	    return -1;
-	if (e->eindex() >= _thread_preferences.size())
+	if (e->eindex() >= _thread_preferences.size()) {
 	    _thread_preferences.resize(e->eindex() + 1, THREAD_UNKNOWN);
+	    _migratable.resize(e->eindex() + 1, -1);
+	}
+	_migratable[e->eindex()] = migratable;
 	if (preference < -1 || preference >= master()->nthreads()) {
 	    errh->warning("thread preference %d out of range", preference);
 	    preference = (preference < 0 ? -1 : 0);
@@ -69,5 +74,17 @@ StaticThreadSched::initial_home_thread_id(const Element *e)
 	return THREAD_UNKNOWN;
 }
 
+bool
+StaticThreadSched::initial_migratable(const Element *e)
+{
+    int eidx = e->eindex();
+    if (eidx >= 0 && eidx < _migratable.size() && _migratable[eidx] >= 0)
+	return _migratable[eidx];
+    if (_next_thread_sched)
+	return _next_thread_sched->initial_migratable(e);
+    else
+	return false;
+}
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(StaticThreadSched)
@@ -7,13 +7,18 @@ CLICK_DECLS
 
 /*
  * =c
- * StaticThreadSched(ELEMENT THREAD, ...)
+ * StaticThreadSched(ELEMENT THREAD [MIGRATABLE], ...)
  * =s threads
  * specifies element and thread scheduling parameters
  * =d
  * Statically binds elements to threads. If more than one StaticThreadSched
  * is specified, they will all run. The one that runs later may override an
  * earlier run.
+ *
+ * If the optional MIGRATABLE boolean is true, ELEMENT's tasks start on
+ * THREAD but may be stolen by idle threads when the driver runs with work
+ * stealing enabled (for instance, with userlevel click's --work-stealing
+ * option). Only mark elements whose tasks are safe to run on any thread.
  * =a
  * ThreadMonitor, BalancedThreadSched
  */
@@ -28,10 +33,12 @@ class StaticThreadSched : public Element, public ThreadSched { public:
     int configure(Vector<String> &, ErrorHandler *);
 
     int initial_home_thread_id(const Element *e);
+    bool initial_migratable(const Element *e);
 
   private:
 
     Vector<int> _thread_preferences;
+    Vector<int> _migratable;
     ThreadSched *_next_thread_sched;
 
 };
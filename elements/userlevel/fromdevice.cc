@@ -75,6 +75,15 @@ FromDevice::~FromDevice()
 {
 }
 
+void *
+FromDevice::cast(const char *n)
+{
+    if (strcmp(n, Notifier::IDLE_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_idle_notifier);
+    else
+	return Element::cast(n);
+}
+
 int
 FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 {
@@ -146,9 +155,23 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     _sniffer = sniffer;
     _promisc = promisc;
     _outbound = outbound;
+    _idle_notifier.initialize(Notifier::IDLE_NOTIFIER, router());
     return 0;
 }
 
+/*
+ * A short burst means the device ran dry: wake listeners on the idle
+ * notifier, e.g. a Batcher waiting to flush a partial batch.
+ */
+inline void
+FromDevice::note_burst(int n)
+{
+    if (n < _burst)
+	_idle_notifier.wake();
+    else
+	_idle_notifier.sleep();
+}
+
 #if FROMDEVICE_LINUX
 int
 FromDevice::open_packet_socket(String ifname, ErrorHandler *errh)
@@ -438,7 +461,9 @@ FromDevice::selected(int fd, int mask)
 #if FROMDEVICE_ALLOW_PCAP
     if (_method == method_pcap) {
 	// Read and push() at most one burst of packets.
+	_idle_notifier.sleep();
 	int r = pcap_dispatch(_pcap, _burst, FromDevice_get_packet, (u_char *) this);
+	note_burst(r);
 	if (r > 0) {
 	    _count += r;
 	    _pcap_task.reschedule();
@@ -448,6 +473,8 @@ FromDevice::selected(int fd, int mask)
 #endif
 #if FROMDEVICE_LINUX
     int nlinux = 0;
+    if (_capture == CAPTURE_LINUX)
+	_idle_notifier.sleep();
     while (_capture == CAPTURE_LINUX && nlinux < _burst) {
 	struct sockaddr_ll sa;
 	socklen_t fromlen = sizeof(sa);
@@ -475,6 +502,8 @@ FromDevice::selected(int fd, int mask)
 	    break;
 	}
     }
+    if (_capture == CAPTURE_LINUX)
+	note_burst(nlinux);
 #endif
 }
 
@@ -483,7 +512,9 @@ bool
 FromDevice::run_task(Task *)
 {
     // Read and push() at most one packet.
+    _idle_notifier.sleep();
     int r = pcap_dispatch(_pcap, _burst, FromDevice_get_packet, (u_char *) this);
+    note_burst(r);
     if (r > 0) {
 	_count += r;
 	_pcap_task.fast_reschedule();
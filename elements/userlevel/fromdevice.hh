@@ -1,6 +1,7 @@
 #ifndef CLICK_FROMDEVICE_USERLEVEL_HH
 #define CLICK_FROMDEVICE_USERLEVEL_HH
 #include <click/element.hh>
+#include <click/notifier.hh>
 #include "elements/userlevel/kernelfilter.hh"
 #ifdef __linux__
 # define FROMDEVICE_LINUX 1
@@ -113,6 +114,10 @@ Integer. Maximum number of packets to read per scheduling. Defaults to 1.
 
 =back
 
+FromDevice provides an idle notifier, which becomes active whenever a read
+returns fewer than BURST packets. A downstream Batcher with FLUSH_ON_IDLE
+set uses it to push partial batches right away.
+
 =e
 
   FromDevice(eth0) -> ...
@@ -158,6 +163,7 @@ class FromDevice : public Element { public:
     int initialize(ErrorHandler *);
     void cleanup(CleanupStage);
     void add_handlers();
+    void *cast(const char *);
 
     inline String ifname() const	{ return _ifname; }
     inline int fd() const		{ return _fd; }
@@ -199,6 +205,9 @@ class FromDevice : public Element { public:
     bool _force_ip;
     int _burst;
     int _datalink;
+    ActiveNotifier _idle_notifier;
+
+    inline void note_burst(int n);
 
 #if HAVE_INT64_TYPES
     typedef uint64_t counter_t;
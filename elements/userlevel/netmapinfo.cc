@@ -23,6 +23,7 @@
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <click/sync.hh>
+#include <click/pbatch.hh>
 #include <unistd.h>
 #include <fcntl.h>
 CLICK_DECLS
@@ -33,10 +34,19 @@ static size_t netmap_memory_size;
 static uint32_t netmap_memory_users;
 
 unsigned char *NetmapInfo::buffers;
+Spinlock NetmapInfo::buffers_lock;
 
+/*
+ * Register ifname with netmap. With queue >= 0, the descriptor is bound
+ * to that hardware ring pair only (NETMAP_HW_RING), so that each queue can
+ * be served by its own element and thread; otherwise to all of them.
+ * netmap also hands over up to extra_buffers buffers outside the rings,
+ * which go to the free list for refill().
+ */
 int
 NetmapInfo::ring::open(const String &ifname,
-		       bool always_error, ErrorHandler *errh)
+		       bool always_error, ErrorHandler *errh, int queue,
+		       unsigned extra_buffers)
 {
     ErrorHandler *initial_errh = always_error ? errh : ErrorHandler::silent_handler();
 
@@ -60,6 +70,12 @@ NetmapInfo::ring::open(const String &ifname,
 	return -1;
     }
     size_t memsize = req.nr_memsize;
+    if (queue >= 0 && queue >= req.nr_rx_rings && queue >= req.nr_tx_rings) {
+	errh->error("netmap %s: no queue %d, it has %d", ifname.c_str(),
+		    queue, req.nr_rx_rings > req.nr_tx_rings ? req.nr_rx_rings : req.nr_tx_rings);
+	goto error;
+    }
+    this->queue = queue;
 
     netmap_memory_lock.acquire();
     if (netmap_memory == MAP_FAILED) {
@@ -71,6 +87,9 @@ NetmapInfo::ring::open(const String &ifname,
 	    netmap_memory_lock.release();
 	    goto error;
 	}
+	// Let zero-copy Batchers refer to packets in netmap buffers. The
+	// device is expected to see this memory at the same address.
+	PBatchRegion::add(netmap_memory, netmap_memory, netmap_memory_size);
     }
     mem = (char *) netmap_memory;
     ++netmap_memory_users;
@@ -79,15 +98,25 @@ NetmapInfo::ring::open(const String &ifname,
     memset(&req, 0, sizeof(req));
     strncpy(req.nr_name, ifname.c_str(), sizeof(req.nr_name));
     req.nr_version = NETMAP_API;
-    req.nr_ringid = 0 | NETMAP_NO_TX_POLL;
+    req.nr_ringid = (queue >= 0 ? NETMAP_HW_RING | queue : 0) | NETMAP_NO_TX_POLL;
+    req.nr_arg3 = extra_buffers;
 
     if ((r = ioctl(fd, NIOCREGIF, &req))) {
 	errh->error("netmap register %s: %s", ifname.c_str(), strerror(errno));
 	goto error;
     }
 
-
     nifp = NETMAP_IF(mem, req.nr_offset);
+
+    // The extra buffers are linked through their first word by index.
+    extra = 0;
+    struct netmap_ring *any = NETMAP_TXRING(nifp, 0);
+    for (uint32_t idx = nifp->ni_bufs_head; idx; ++extra) {
+	unsigned char *buf = (unsigned char *) NETMAP_BUF(any, idx);
+	idx = *reinterpret_cast<uint32_t *>(buf);
+	buffer_destructor(buf, 0);
+    }
+    nifp->ni_bufs_head = 0;
     return fd;
 }
 
@@ -97,6 +126,10 @@ NetmapInfo::ring::initialize_rings_rx(int timestamp)
     ring_begin = 0;
     // 0 means "same count as the converse direction"
     ring_end = nifp->ni_rx_rings ? nifp->ni_rx_rings : nifp->ni_tx_rings;
+    if (queue >= 0) {
+	ring_begin = queue;
+	ring_end = queue + 1;
+    }
     if (timestamp >= 0) {
 	int flags = (timestamp > 0 ? NR_TIMESTAMP : 0);
 	for (unsigned i = ring_begin; i != ring_end; ++i)
@@ -109,19 +142,38 @@ NetmapInfo::ring::initialize_rings_tx()
 {
     ring_begin = 0;
     ring_end = nifp->ni_tx_rings ? nifp->ni_tx_rings : nifp->ni_rx_rings;
+    if (queue >= 0) {
+	ring_begin = queue;
+	ring_end = queue + 1;
+    }
 }
 
 void
 NetmapInfo::ring::close(int fd)
 {
+    // Give back as many free buffers as were taken at open; netmap frees
+    // the list at ni_bufs_head when the descriptor is closed. Buffers
+    // still held by packets are not returned.
+    struct netmap_ring *any = NETMAP_TXRING(nifp, 0);
+    uint32_t head = 0;
+    buffers_lock.acquire();
+    for (; extra && buffers; --extra) {
+	unsigned char *buf = buffers;
+	buffers = *reinterpret_cast<unsigned char **>(buf);
+	*reinterpret_cast<uint32_t *>(buf) = head;
+	head = NETMAP_BUF_IDX(any, (char *) buf);
+    }
+    buffers_lock.release();
+    nifp->ni_bufs_head = head;
+    ::close(fd);
+
     netmap_memory_lock.acquire();
     if (--netmap_memory_users <= 0 && netmap_memory != MAP_FAILED) {
+	PBatchRegion::remove(netmap_memory);
 	munmap(netmap_memory, netmap_memory_size);
 	netmap_memory = MAP_FAILED;
     }
     netmap_memory_lock.release();
-    ioctl(fd, NIOCUNREGIF, (struct nmreq *) 0);
-    ::close(fd);
 }
 
 CLICK_ENDDECLS
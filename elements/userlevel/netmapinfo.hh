@@ -0,0 +1,73 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_NETMAPINFO_HH
+#define CLICK_NETMAPINFO_HH 1
+#if HAVE_NET_NETMAP_H
+#include <net/if.h>
+#include <net/netmap.h>
+#include <net/netmap_user.h>
+#if NETMAP_API < 11
+# error "netmap API 11 or later is required (ring head, cur and tail)"
+#endif
+#include <click/packet.hh>
+#include <click/error.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+
+class NetmapInfo { public:
+
+    struct ring {
+	char *mem;
+	unsigned ring_begin;
+	unsigned ring_end;
+	int queue;		// the hardware ring bound, -1 for all
+	struct netmap_if *nifp;
+	unsigned extra;		// extra buffers taken into buffers
+
+	int open(const String &ifname,
+		 bool always_error, ErrorHandler *errh, int queue = -1,
+		 unsigned extra_buffers = 0);
+	void initialize_rings_rx(int timestamp);
+	void initialize_rings_tx();
+	void close(int fd);
+    };
+
+    // Free netmap buffers, linked through their first word. Packets
+    // holding buffers may be killed on any thread, e.g. when a batch is
+    // killed, so the list is kept under buffers_lock.
+    static unsigned char *buffers;
+    static Spinlock buffers_lock;
+
+    static void buffer_destructor(unsigned char *buf, size_t) {
+	buffers_lock.acquire();
+	*reinterpret_cast<unsigned char **>(buf) = buffers;
+	buffers = buf;
+	buffers_lock.release();
+    }
+
+    static bool is_netmap_buffer(const Packet *p) {
+	return p->buffer_destructor() == buffer_destructor;
+    }
+
+    /** @brief Give @a ring's current slot a free buffer.
+     *
+     * The slot's old buffer then belongs to the caller, who frees it with
+     * buffer_destructor(), e.g. by wrapping it in a Packet. Returns false
+     * if no buffer is free. */
+    static bool refill(struct netmap_ring *ring) {
+	buffers_lock.acquire();
+	unsigned char *buf = buffers;
+	if (buf)
+	    buffers = *reinterpret_cast<unsigned char **>(buf);
+	buffers_lock.release();
+	if (!buf)
+	    return false;
+	ring->slot[ring->cur].buf_idx = NETMAP_BUF_IDX(ring, (char *) buf);
+	ring->slot[ring->cur].flags |= NS_BUF_CHANGED;
+	return true;
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
+#endif
@@ -29,6 +29,7 @@
 #include <click/etheraddress.hh>
 #include <click/args.hh>
 #include <click/router.hh>
+#include <click/master.hh>
 #include <click/standard/scheduleinfo.hh>
 #include <click/packet_anno.hh>
 #include <click/straccum.hh>
@@ -64,8 +65,10 @@ ToDevice::ToDevice()
     _pcap = 0;
     _my_pcap = false;
 #endif
-#if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD
+#if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD || TODEVICE_ALLOW_NETMAP
     _fd = -1;
+#endif
+#if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD
     _my_fd = false;
 #endif
 }
@@ -78,18 +81,31 @@ int
 ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String method;
+    int thread = -1;
     _burst = 1;
+    _queue = -1;
     if (Args(conf, this, errh)
 	.read_mp("DEVNAME", _ifname)
 	.read("DEBUG", _debug)
 	.read("METHOD", WordArg(), method)
 	.read("BURST", _burst)
+	.read("QUEUE", _queue)
+	.read("THREAD", thread)
 	.complete() < 0)
 	return -1;
     if (!_ifname)
 	return errh->error("interface not set");
     if (_burst <= 0)
 	return errh->error("bad BURST");
+#if !TODEVICE_ALLOW_NETMAP
+    if (_queue >= 0)
+	return errh->error("QUEUE requires netmap");
+#endif
+    if (thread >= master()->nthreads())
+	return errh->error("THREAD %d out of range, there are %d threads",
+			   thread, master()->nthreads());
+    if (thread >= 0)
+	router()->set_home_thread_id(this, thread);
 
     if (method == "") {
 #if TODEVICE_ALLOW_PCAP && TODEVICE_ALLOW_LINUX
@@ -124,10 +140,16 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 #if TODEVICE_ALLOW_PCAPFD
     else if (method == "PCAPFD")
 	_method = method_pcapfd;
+#endif
+#if TODEVICE_ALLOW_NETMAP
+    else if (method == "NETMAP")
+	_method = method_netmap;
 #endif
     else
 	return errh->error("bad METHOD");
 
+    if (_queue >= 0 && _method != method_netmap)
+	return errh->error("QUEUE requires METHOD NETMAP");
     return 0;
 }
 
@@ -213,14 +235,29 @@ ToDevice::initialize(ErrorHandler *errh)
     }
 #endif
 
-    // check for duplicate writers
-    void *&used = router()->force_attachment("device_writer_" + _ifname);
+#if TODEVICE_ALLOW_NETMAP
+    if (_method == method_netmap) {
+	_fd = _netmap.open(_ifname, true, errh, _queue);
+	if (_fd < 0)
+	    return -1;
+	_netmap.initialize_rings_tx();
+    }
+#endif
+
+    // check for duplicate writers, per queue
+    String writer = "device_writer_" + _ifname;
+    if (_queue >= 0)
+	writer += "#" + String(_queue);
+    void *&used = router()->force_attachment(writer);
     if (used)
 	return errh->error("duplicate writer for device %<%s%>", _ifname.c_str());
     used = this;
 
-    ScheduleInfo::join_scheduler(this, &_task, errh);
-    _signal = Notifier::upstream_empty_signal(this, 0, &_task);
+    // Subclasses may take pushed packets instead.
+    if (input_is_pull(0)) {
+	ScheduleInfo::join_scheduler(this, &_task, errh);
+	_signal = Notifier::upstream_empty_signal(this, 0, &_task);
+    }
     return 0;
 }
 
@@ -232,13 +269,70 @@ ToDevice::cleanup(CleanupStage)
 	pcap_close(_pcap);
     _pcap = 0;
 #endif
+#if TODEVICE_ALLOW_NETMAP
+    if (_method == method_netmap && _fd >= 0)
+	_netmap.close(_fd);
+#endif
 #if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD
     if (_fd >= 0 && _my_fd)
 	close(_fd);
+#endif
+#if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD || TODEVICE_ALLOW_NETMAP
     _fd = -1;
 #endif
 }
 
+#if TODEVICE_ALLOW_NETMAP
+/*
+ * Put p in the first TX ring with a free slot, without syncing. A packet
+ * that owns a whole netmap buffer is swapped into the slot rather than
+ * copied, unless it still has to go out an output.
+ */
+int
+ToDevice::netmap_send_packet(Packet *p)
+{
+    for (unsigned ri = _netmap.ring_begin; ri != _netmap.ring_end; ++ri) {
+	struct netmap_ring *ring = NETMAP_TXRING(_netmap.nifp, ri);
+	if (nm_ring_empty(ring))
+	    continue;
+	unsigned cur = ring->cur;
+	unsigned buf_idx = ring->slot[cur].buf_idx;
+	if (buf_idx < 2)
+	    continue;
+	uint32_t len = p->length();
+	if (len > ring->nr_buf_size)
+	    return -EMSGSIZE;
+	unsigned char *buf = (unsigned char *) NETMAP_BUF(ring, buf_idx);
+	if (NetmapInfo::is_netmap_buffer(p) && !p->shared()
+	    && p->buffer() == p->data() && noutputs() == 0) {
+	    ring->slot[cur].buf_idx = NETMAP_BUF_IDX(ring, (char *) p->buffer());
+	    ring->slot[cur].flags |= NS_BUF_CHANGED;
+	    p->reset_buffer();
+	    NetmapInfo::buffer_destructor(buf, 0);
+	} else
+	    memcpy(buf, p->data(), len);
+	ring->slot[cur].len = len;
+	__asm__ volatile("" : : : "memory");
+	ring->head = ring->cur = nm_ring_next(ring, cur);
+	return 0;
+    }
+    return -ENOBUFS;
+}
+#endif
+
+/*
+ * Push out what send_packet() queued. Only netmap queues, the other
+ * methods send right away.
+ */
+void
+ToDevice::sync_tx()
+{
+#if TODEVICE_ALLOW_NETMAP
+    if (_method == method_netmap)
+	ioctl(_fd, NIOCTXSYNC, 0);
+#endif
+}
+
 
 /*
  * Linux select marks datagram fd's as writeable when the socket
@@ -256,6 +350,11 @@ ToDevice::send_packet(Packet *p)
     int r = 0;
     errno = 0;
 
+#if TODEVICE_ALLOW_NETMAP
+    if (_method == method_netmap)
+	return netmap_send_packet(p);
+#endif
+
 #if TODEVICE_ALLOW_PCAP
     if (_method == method_pcap) {
 # if HAVE_PCAP_INJECT
@@ -310,6 +409,9 @@ ToDevice::run_task(Task *)
 	    break;
     } while (count < _burst);
 
+    if (count > 0 || r == -ENOBUFS)
+	sync_tx();
+
     if (r == -ENOBUFS || r == -EAGAIN) {
 	assert(!_q);
 	_q = p;
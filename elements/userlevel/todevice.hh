@@ -35,6 +35,21 @@ CLICK_DECLS
  * Word. Defines the method ToDevice will use to write packets to the
  * device. Linux targets generally support PCAP and LINUX; other targets
  * support PCAP or, occasionally, other methods. Generally defaults to PCAP.
+ * NETMAP, where available, writes packets to the device's netmap TX rings,
+ * and syncs the rings once per burst rather than once per packet. Packets
+ * whose buffers are netmap buffers are handed to the ring rather than
+ * copied, when ToDevice has no outputs.
+ *
+ * =item QUEUE
+ *
+ * Integer. With METHOD NETMAP, send on this hardware TX ring only, so that
+ * one ToDevice per queue can run on its own thread. Defaults to all rings.
+ * An error if Click was built without netmap.
+ *
+ * =item THREAD
+ *
+ * Integer. The thread that runs this element, overriding any thread
+ * scheduler, e.g. the thread serving the same QUEUE in a FromDevice.
  *
  * =item DEBUG
  *
@@ -77,6 +92,10 @@ extern "C" {
 #elif defined(__sun)
 # define TODEVICE_ALLOW_PCAPFD 1
 #endif
+#if HAVE_NET_NETMAP_H
+# include "elements/userlevel/netmapinfo.hh"
+# define TODEVICE_ALLOW_NETMAP 1
+#endif
 class FromDevice;
 
 class ToDevice : public Element { public:
@@ -101,6 +120,11 @@ class ToDevice : public Element { public:
     bool run_task(Task *);
     void selected(int fd, int mask);
 
+  protected:
+
+    int send_packet(Packet *p);
+    void sync_tx();
+
   private:
 
     Task _task;
@@ -110,15 +134,20 @@ class ToDevice : public Element { public:
 #if TODEVICE_ALLOW_PCAP
     pcap_t *_pcap;
 #endif
-#if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD
+#if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD || TODEVICE_ALLOW_NETMAP
     int _fd;
 #endif
-    enum { method_linux, method_pcap, method_devbpf, method_pcapfd };
+#if TODEVICE_ALLOW_NETMAP
+    NetmapInfo::ring _netmap;
+    int netmap_send_packet(Packet *p);
+#endif
+    enum { method_linux, method_pcap, method_devbpf, method_pcapfd, method_netmap };
     int _method;
     NotifierSignal _signal;
 
     Packet *_q;
     int _burst;
+    int _queue;
 
     bool _debug;
 #if TODEVICE_ALLOW_PCAP
@@ -132,7 +161,6 @@ class ToDevice : public Element { public:
 
     enum { h_debug, h_signal, h_pulls, h_q };
     FromDevice *find_fromdevice() const;
-    int send_packet(Packet *p);
     static int write_param(const String &in_s, Element *e, void *vparam, ErrorHandler *errh);
     static String read_param(Element *e, void *thunk);
 
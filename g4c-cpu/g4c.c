@@ -0,0 +1,382 @@
+/*
+ * g4c.c -- host-only implementation of the g4c runtime, see g4c.h.
+ */
+#include "g4c.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+enum { G4C_OP_COPY, G4C_OP_MEMSET, G4C_OP_NOTIFY };
+
+struct g4c_op {
+	int kind;
+	void *dst;
+	const void *src;
+	size_t sz;
+	int val;
+	g4c_notify_fn fn;	/* G4C_OP_NOTIFY, called with src as arg */
+	struct g4c_op *next;
+};
+
+struct g4c_stream {
+	int used;
+	int queued;		/* on the ready ring or being run by a worker */
+	int pending;		/* operations not completed yet, but notifies */
+	int notifies;		/* notifies not called back yet */
+	struct g4c_op *head, *tail;
+};
+
+static pthread_mutex_t g4c_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g4c_work_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g4c_done_cv = PTHREAD_COND_INITIALIZER;
+
+static struct g4c_stream *g4c_streams;
+static int g4c_nr_streams;
+
+/* Streams with work, each appears at most once. */
+static int *g4c_ready;
+static int g4c_ready_head, g4c_ready_tail;
+
+static struct g4c_op *g4c_free_ops;
+
+static pthread_t *g4c_workers;
+static int g4c_nr_workers;
+static int g4c_shutdown;
+
+static long g4c_latency_ns;
+static long g4c_bandwidth_mbps;
+
+static long
+g4c_env(const char *name, long dflt)
+{
+	const char *v = getenv(name);
+	return v && *v ? atol(v) : dflt;
+}
+
+static long long
+g4c_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+g4c_delay(size_t sz)
+{
+	long long ns = g4c_latency_ns;
+	long long until;
+
+	if (g4c_bandwidth_mbps > 0)
+		ns += (long long)sz * 1000 / g4c_bandwidth_mbps;
+	if (ns <= 0)
+		return;
+
+	until = g4c_now_ns() + ns;
+	while (g4c_now_ns() < until)
+		__asm__ __volatile__ ("" ::: "memory");
+}
+
+static void
+g4c_run_op(int s, struct g4c_op *op)
+{
+	if (op->kind == G4C_OP_NOTIFY) {
+		op->fn(s, (void *)op->src);
+		return;
+	}
+	g4c_delay(op->sz);
+	if (op->kind == G4C_OP_COPY)
+		memcpy(op->dst, op->src, op->sz);
+	else
+		memset(op->dst, op->val, op->sz);
+}
+
+static void *
+g4c_worker(void *arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&g4c_lock);
+	for (;;) {
+		struct g4c_stream *st;
+		int s;
+
+		while (!g4c_shutdown && g4c_ready_head == g4c_ready_tail)
+			pthread_cond_wait(&g4c_work_cv, &g4c_lock);
+		if (g4c_shutdown)
+			break;
+
+		s = g4c_ready[g4c_ready_tail];
+		g4c_ready_tail = (g4c_ready_tail + 1) % (g4c_nr_streams + 1);
+		st = &g4c_streams[s];
+
+		/* Run the stream's operations in order, dropping the lock
+		 * while each one executes. */
+		while (st->head) {
+			struct g4c_op *op = st->head;
+
+			pthread_mutex_unlock(&g4c_lock);
+			g4c_run_op(s, op);
+			pthread_mutex_lock(&g4c_lock);
+
+			st->head = op->next;
+			if (!st->head)
+				st->tail = 0;
+			op->next = g4c_free_ops;
+			g4c_free_ops = op;
+			if (op->kind != G4C_OP_NOTIFY)
+				__atomic_store_n(&st->pending, st->pending - 1,
+						 __ATOMIC_RELEASE);
+			else
+				st->notifies--;
+		}
+		st->queued = 0;
+		pthread_cond_broadcast(&g4c_done_cv);
+	}
+	pthread_mutex_unlock(&g4c_lock);
+	return 0;
+}
+
+int
+g4c_init(int nr_streams, size_t hostmem_sz, size_t devmem_sz)
+{
+	int i;
+
+	(void)hostmem_sz;
+	(void)devmem_sz;
+
+	if (nr_streams <= 0)
+		nr_streams = G4C_DEFAULT_NR_STREAMS;
+
+	g4c_nr_workers = (int)g4c_env("G4C_CPU_WORKERS", 1);
+	if (g4c_nr_workers <= 0)
+		g4c_nr_workers = 1;
+	g4c_latency_ns = g4c_env("G4C_CPU_LATENCY_US", 0) * 1000;
+	g4c_bandwidth_mbps = g4c_env("G4C_CPU_BANDWIDTH", 0);
+
+	/* stream ids are 1..nr_streams */
+	g4c_nr_streams = nr_streams;
+	g4c_streams = (struct g4c_stream *)calloc(nr_streams + 1, sizeof(struct g4c_stream));
+	g4c_ready = (int *)calloc(nr_streams + 1, sizeof(int));
+	g4c_workers = (pthread_t *)calloc(g4c_nr_workers, sizeof(pthread_t));
+	if (!g4c_streams || !g4c_ready || !g4c_workers)
+		goto fail;
+	g4c_ready_head = g4c_ready_tail = 0;
+	g4c_shutdown = 0;
+
+	for (i = 0; i < g4c_nr_workers; i++)
+		if (pthread_create(&g4c_workers[i], 0, g4c_worker, 0)) {
+			g4c_nr_workers = i;
+			g4c_exit();
+			return -1;
+		}
+
+	fprintf(stderr, "g4c: host-only runtime, %d streams, %d workers, "
+		"latency %ld us, bandwidth %ld MB/s\n", nr_streams,
+		g4c_nr_workers, g4c_latency_ns / 1000, g4c_bandwidth_mbps);
+	return 0;
+
+fail:
+	free(g4c_streams);
+	free(g4c_ready);
+	free(g4c_workers);
+	g4c_streams = 0;
+	g4c_ready = 0;
+	g4c_workers = 0;
+	return -1;
+}
+
+void
+g4c_exit(void)
+{
+	int i;
+	struct g4c_op *op;
+
+	pthread_mutex_lock(&g4c_lock);
+	g4c_shutdown = 1;
+	pthread_cond_broadcast(&g4c_work_cv);
+	pthread_mutex_unlock(&g4c_lock);
+
+	for (i = 0; i < g4c_nr_workers; i++)
+		pthread_join(g4c_workers[i], 0);
+
+	for (i = 1; g4c_streams && i <= g4c_nr_streams; i++)
+		while ((op = g4c_streams[i].head)) {
+			g4c_streams[i].head = op->next;
+			free(op);
+		}
+	while ((op = g4c_free_ops)) {
+		g4c_free_ops = op->next;
+		free(op);
+	}
+
+	free(g4c_streams);
+	free(g4c_ready);
+	free(g4c_workers);
+	g4c_streams = 0;
+	g4c_ready = 0;
+	g4c_workers = 0;
+	g4c_nr_streams = 0;
+	g4c_nr_workers = 0;
+}
+
+void *
+g4c_alloc_page_lock_mem(size_t sz)
+{
+	void *p;
+	if (posix_memalign(&p, G4C_PAGE_SIZE, sz))
+		return 0;
+	return p;
+}
+
+void
+g4c_free_page_lock_mem(void *p)
+{
+	free(p);
+}
+
+void *
+g4c_alloc_dev_mem(size_t sz)
+{
+	return g4c_alloc_page_lock_mem(sz);
+}
+
+void
+g4c_free_dev_mem(void *p)
+{
+	free(p);
+}
+
+int
+g4c_alloc_stream(void)
+{
+	int i, s = 0;
+
+	pthread_mutex_lock(&g4c_lock);
+	for (i = 1; i <= g4c_nr_streams; i++)
+		if (!g4c_streams[i].used) {
+			g4c_streams[i].used = 1;
+			s = i;
+			break;
+		}
+	pthread_mutex_unlock(&g4c_lock);
+	return s;
+}
+
+void
+g4c_free_stream(int s)
+{
+	if (s <= 0 || s > g4c_nr_streams)
+		return;
+	g4c_stream_sync(s);
+	pthread_mutex_lock(&g4c_lock);
+	g4c_streams[s].used = 0;
+	pthread_mutex_unlock(&g4c_lock);
+}
+
+int
+g4c_stream_done(int s)
+{
+	if (s <= 0 || s > g4c_nr_streams)
+		return 1;
+	return __atomic_load_n(&g4c_streams[s].pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+int
+g4c_stream_sync(int s)
+{
+	if (s <= 0 || s > g4c_nr_streams)
+		return 0;
+	pthread_mutex_lock(&g4c_lock);
+	while (g4c_streams[s].pending || g4c_streams[s].notifies)
+		pthread_cond_wait(&g4c_done_cv, &g4c_lock);
+	pthread_mutex_unlock(&g4c_lock);
+	return 0;
+}
+
+static int
+g4c_enqueue(int kind, void *dst, const void *src, size_t sz, int val,
+	    g4c_notify_fn fn, int s)
+{
+	struct g4c_stream *st;
+	struct g4c_op *op;
+
+	if (s <= 0 || s > g4c_nr_streams)
+		return -1;
+
+	pthread_mutex_lock(&g4c_lock);
+	if ((op = g4c_free_ops))
+		g4c_free_ops = op->next;
+	else if (!(op = (struct g4c_op *)malloc(sizeof(*op)))) {
+		pthread_mutex_unlock(&g4c_lock);
+		return -1;
+	}
+
+	op->kind = kind;
+	op->dst = dst;
+	op->src = src;
+	op->sz = sz;
+	op->val = val;
+	op->fn = fn;
+	op->next = 0;
+
+	st = &g4c_streams[s];
+	if (st->tail)
+		st->tail->next = op;
+	else
+		st->head = op;
+	st->tail = op;
+	if (kind != G4C_OP_NOTIFY)
+		__atomic_store_n(&st->pending, st->pending + 1, __ATOMIC_RELEASE);
+	else
+		st->notifies++;
+
+	if (!st->queued) {
+		st->queued = 1;
+		g4c_ready[g4c_ready_head] = s;
+		g4c_ready_head = (g4c_ready_head + 1) % (g4c_nr_streams + 1);
+		pthread_cond_signal(&g4c_work_cv);
+	}
+	pthread_mutex_unlock(&g4c_lock);
+	return 0;
+}
+
+int
+g4c_h2d_async(void *h, void *d, size_t sz, int s)
+{
+	return g4c_enqueue(G4C_OP_COPY, d, h, sz, 0, 0, s);
+}
+
+int
+g4c_d2h_async(void *d, void *h, size_t sz, int s)
+{
+	return g4c_enqueue(G4C_OP_COPY, h, d, sz, 0, 0, s);
+}
+
+int
+g4c_dev_memset(void *d, int val, size_t sz, int s)
+{
+	return g4c_enqueue(G4C_OP_MEMSET, d, 0, sz, val, 0, s);
+}
+
+int
+g4c_stream_notify(int s, g4c_notify_fn fn, void *arg)
+{
+	int idle;
+
+	if (s <= 0 || s > g4c_nr_streams)
+		return -1;
+	/* Only the stream's user queues work on it, so neither count can
+	 * go up behind our back. Earlier notifies still queued must be
+	 * called back first, so only a stream with nothing left at all
+	 * calls back right away. */
+	pthread_mutex_lock(&g4c_lock);
+	idle = !g4c_streams[s].pending && !g4c_streams[s].notifies;
+	pthread_mutex_unlock(&g4c_lock);
+	if (idle) {
+		fn(s, arg);
+		return 0;
+	}
+	return g4c_enqueue(G4C_OP_NOTIFY, 0, arg, 0, 0, fn, s);
+}
@@ -0,0 +1,77 @@
+#ifndef __G4C_H__
+#define __G4C_H__
+/*
+ * Host-only g4c.
+ *
+ * Drop-in replacement for the CUDA libg4c, for hosts without a GPU.
+ * "Device" memory is plain host memory, and async copies and memsets are
+ * executed in stream order by a pool of worker threads, so
+ * g4c_stream_done() and g4c_stream_sync() report real completion.
+ *
+ * Tunables are read from the environment at g4c_init() time:
+ *   G4C_CPU_WORKERS:    number of worker threads, default 1.
+ *   G4C_CPU_LATENCY_US: latency injected before each operation, default 0.
+ *   G4C_CPU_BANDWIDTH:  emulated bus bandwidth in MB/s, default 0, which
+ *                       means as fast as memcpy.
+ * Injected delays are busy-waited by the workers to keep microsecond
+ * accuracy.
+ *
+ * Beyond the CUDA libg4c API, g4c_stream_notify() calls a function once a
+ * stream's queued work has completed, after any earlier notifies of that
+ * stream; G4C_HAVE_STREAM_NOTIFY tells users it is there.
+ *
+ * Build with "make" in this directory, or let "hvpconfigure PREFIX cpu"
+ * do it.
+ */
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define G4C_PAGE_SIZE 4096
+#define G4C_MEM_ALIGN 32
+#define G4C_DEFAULT_MEM_SIZE (0x1<<30)
+#define G4C_DEFAULT_NR_STREAMS 32
+
+#define g4c_to_ul(v) ((unsigned long)(v))
+#define g4c_ptr_add(ptr, offset) ((void*)(((unsigned char*)(ptr)) + (offset)))
+#define g4c_ptr_offset(ptr, base) (g4c_to_ul(ptr) - g4c_to_ul(base))
+#define g4c_round_up(v, align) ((((v) + (align) - 1) / (align)) * (align))
+#define g4c_to_volatile(x) (*((volatile __typeof__(x) *)(&(x))))
+
+int g4c_init(int nr_streams, size_t hostmem_sz, size_t devmem_sz);
+void g4c_exit(void);
+
+void *g4c_alloc_page_lock_mem(size_t sz);
+void g4c_free_page_lock_mem(void *p);
+void *g4c_alloc_dev_mem(size_t sz);
+void g4c_free_dev_mem(void *p);
+
+/* Stream 0 is never a valid stream, it means allocation failure. */
+int g4c_alloc_stream(void);
+void g4c_free_stream(int s);
+
+int g4c_stream_sync(int s);
+int g4c_stream_done(int s);
+
+int g4c_h2d_async(void *h, void *d, size_t sz, int s);
+int g4c_d2h_async(void *d, void *h, size_t sz, int s);
+int g4c_dev_memset(void *d, int val, size_t sz, int s);
+
+/*
+ * Call fn(s, arg) once the operations queued on s so far have completed,
+ * from a worker thread, or right away from the caller when there are
+ * none. fn must not call back into g4c. Returns -1 for a bad stream or
+ * out of memory. Like a CUDA host callback, a queued fn is part of the
+ * stream for g4c_stream_sync(), but not for g4c_stream_done().
+ */
+#define G4C_HAVE_STREAM_NOTIFY 1
+typedef void (*g4c_notify_fn)(int s, void *arg);
+int g4c_stream_notify(int s, g4c_notify_fn fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
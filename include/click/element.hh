@@ -45,7 +45,7 @@ class Element { public:
     virtual bool run_task(Task *task);	// return true iff did useful work
     virtual void run_timer(Timer *timer);
 #if CLICK_USERLEVEL
-    enum { SELECT_READ = 1, SELECT_WRITE = 2 };
+    enum { SELECT_READ = 1, SELECT_WRITE = 2, SELECT_EDGE = 4 };
     virtual void selected(int fd, int mask);
     virtual void selected(int fd);
 #endif
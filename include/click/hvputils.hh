@@ -2,6 +2,7 @@
 #define __HVP_UTILS_HH__
 
 #include <click/glue.hh>
+#include <click/straccum.hh>
 
 #define hvp_chatter(...)					  \
 	do {							  \
@@ -9,4 +10,78 @@
 		__hvp_chatter( __VA_ARGS__);			  \
 	} while(0);						  \
 
+CLICK_DECLS
+
+/*
+ * Log-linear histogram of unsigned values, such as latencies in usec.
+ * Values below nsub have a bucket each, and every power of two above is
+ * split into nsub buckets, so percentiles are within 1/nsub of the
+ * real value. Not thread safe.
+ */
+class HVPHistogram {
+public:
+	enum { sub_bits = 3, nsub = 1 << sub_bits,
+	       nbuckets = nsub + (64 - sub_bits) * nsub };
+
+	HVPHistogram() { clear(); }
+
+	inline void clear() {
+		memset(_buckets, 0, sizeof(_buckets));
+		_count = _sum = _max = 0;
+	}
+
+	inline void add(uint64_t v) {
+		_buckets[bucket(v)]++;
+		_count++;
+		_sum += v;
+		if (v > _max)
+			_max = v;
+	}
+
+	inline uint64_t count() const { return _count; }
+	inline uint64_t max() const { return _max; }
+	inline uint64_t mean() const { return _count ? _sum / _count : 0; }
+
+	// Smallest bucket bound that num/den of the values are not above.
+	uint64_t percentile(unsigned num, unsigned den) const {
+		uint64_t rank = (_count * num + den - 1) / den, seen = 0;
+		for (int i = 0; i < nbuckets; i++)
+			if ((seen += _buckets[i]) >= rank && seen)
+				return i < nsub ? i : bound(i) < _max ? bound(i) : _max;
+		return _max;
+	}
+
+	String unparse() const {
+		StringAccum sa;
+		sa << "count " << _count << "\nmean " << mean()
+		   << "\np50 " << percentile(50, 100)
+		   << "\np90 " << percentile(90, 100)
+		   << "\np99 " << percentile(99, 100)
+		   << "\np999 " << percentile(999, 1000)
+		   << "\nmax " << _max << '\n';
+		return sa.take_string();
+	}
+
+private:
+	uint64_t _buckets[nbuckets];
+	uint64_t _count;
+	uint64_t _sum;
+	uint64_t _max;
+
+	static inline int bucket(uint64_t v) {
+		if (v < nsub)
+			return v;
+		int m = 63 - __builtin_clzll(v);
+		return nsub + (m - sub_bits) * nsub
+			+ ((v >> (m - sub_bits)) & (nsub - 1));
+	}
+
+	// Largest value of bucket i >= nsub.
+	static inline uint64_t bound(int i) {
+		int k = i - nsub, shift = k / nsub;
+		return (((uint64_t)(nsub + k % nsub + 1)) << shift) - 1;
+	}
+};
+
+CLICK_ENDDECLS
 #endif
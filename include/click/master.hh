@@ -32,6 +32,12 @@ class Master { public:
     inline RouterThread *thread(int id) const;
     void wake_somebody();
 
+    /** @brief Return true iff idle threads steal migratable tasks. */
+    bool work_stealing() const			{ return _work_stealing; }
+    /** @brief Set whether idle threads steal migratable tasks.
+     * @sa Task::set_migratable */
+    void set_work_stealing(bool work_stealing)	{ _work_stealing = work_stealing; }
+
 #if CLICK_USERLEVEL
     int add_signal_handler(int signo, Router *router, String handler);
     int remove_signal_handler(int signo, Router *router, String handler);
@@ -59,6 +65,7 @@ class Master { public:
     // THREADS
     RouterThread **_threads;
     int _nthreads;
+    volatile bool _work_stealing;
 
     // ROUTERS
     Router *_routers;
@@ -204,6 +204,7 @@ class Notifier { public:
 
     static const char EMPTY_NOTIFIER[];
     static const char FULL_NOTIFIER[];
+    static const char IDLE_NOTIFIER[];
 
     static NotifierSignal upstream_empty_signal(Element* e, int port, Task* task, Notifier* dependent_notifier = 0);
     static NotifierSignal downstream_full_signal(Element* e, int port, Task* task, Notifier* dependent_notifier = 0);
@@ -27,6 +27,7 @@ struct click_udp;
 CLICK_DECLS
 
 class IP6Address;
+class StringAccum;
 class WritablePacket;
 
 class Packet { public:
@@ -60,6 +61,11 @@ class Packet { public:
 #endif
 
     static void static_cleanup();
+#if HAVE_CLICK_PACKET_POOL
+    static int configure_pool(uint32_t buffer_length, uint32_t jumbo_length,
+			      bool hugepages);
+    static void pool_statistics(StringAccum &sa);
+#endif
 
     inline void kill();
 
@@ -75,6 +81,11 @@ class Packet { public:
     inline const unsigned char *buffer() const;
     inline const unsigned char *end_buffer() const;
     inline uint32_t buffer_length() const;
+#if CLICK_USERLEVEL
+    typedef void (*buffer_destructor_type)(unsigned char *, size_t);
+    inline buffer_destructor_type buffer_destructor() const;
+    inline void reset_buffer();
+#endif
 
 #if CLICK_LINUXMODULE
     struct sk_buff *skb()		{ return (struct sk_buff *)this; }
@@ -769,7 +780,7 @@ class WritablePacket : public Packet { public:
     ~WritablePacket() { }
 
 #if HAVE_CLICK_PACKET_POOL
-    static WritablePacket *pool_allocate(bool with_data);
+    static WritablePacket *pool_allocate();
     static WritablePacket *pool_allocate(uint32_t headroom, uint32_t length,
 					 uint32_t tailroom);
     static void recycle(WritablePacket *p);
@@ -910,6 +921,32 @@ Packet::end_buffer() const
 #endif
 }
 
+#if CLICK_USERLEVEL
+/** @brief Return the destructor of the packet's buffer.
+ *
+ * This is the destructor passed to Packet::make(unsigned char *, uint32_t,
+ * ...), or the packet pool's for a buffer carved out of huge pages, or null
+ * for a buffer that Click allocated from the heap. */
+inline Packet::buffer_destructor_type
+Packet::buffer_destructor() const
+{
+    return _destructor;
+}
+
+/** @brief Detach the packet from its buffer.
+ *
+ * The buffer is not freed, so its owner can be changed, e.g. by handing it
+ * to a device. The packet is left with no data. The packet must not be
+ * shared(). */
+inline void
+Packet::reset_buffer()
+{
+    assert(!shared());
+    _head = _data = _tail = _end = 0;
+    _destructor = 0;
+}
+#endif
+
 /** @brief Return the packet's length. */
 inline uint32_t
 Packet::length() const
@@ -3,15 +3,152 @@
 // I don't and don't want to know why putting this header at the beginning can avoid compilation errors.
 #include <click/ipaddress.hh>
 #include <click/glue.hh>
+#include <click/timestamp.hh>
+#include <click/packet.hh>
+#include <click/atomic.hh>
+#include <click/hvputils.hh>
 #include <g4c.h>
 
-class Packet;
+class PBatchPool;
 
 #define CLICK_PBATCH_PACKET_BUFFER_SIZE 2048
 #define CLICK_PBATCH_CAPACITY 1024
 
 CLICK_DECLS
 
+class PBatch;
+class ErrorHandler;
+
+/*
+ * Batch lifecycle points, stamped with click_get_cycles() into
+ * PBatch::tstamps by the element named, for traced batches only. The
+ * stage ending at a point is the time since the previous point stamped.
+ */
+enum {
+	PBATCH_TS_FIRST,	// Batcher: first packet added
+	PBATCH_TS_FLUSH,	// Batcher: pushed out (stage "fill")
+	PBATCH_TS_H2D,		// H2D: copies to device issued
+	PBATCH_TS_KERNEL,	// D2H: reached, kernels issued or run
+	PBATCH_TS_D2H,		// D2H: copies to host issued
+	PBATCH_TS_DONE,		// PushBatchQueue, StreamScheduler: stream done
+	PBATCH_TS_DEBATCH,	// DeBatcher, BatchToDevice: packets pushed on
+	PBATCH_NR_TS
+};
+
+/*
+ * Lifecycle statistics of the batches of one Batcher: per stage
+ * histograms in cycles, and optionally the stamps of the last batches
+ * in a ring that can be dumped to a file for offline analysis.
+ * DeBatcher and BatchToDevice record a batch once its packets are out,
+ * see PBatch::trace_debatch(); batches killed on the way and sub-batches
+ * are not recorded. Not thread safe, all the
+ * batches should be debatched on one thread.
+ *
+ * Reference counted: the Batcher holds one reference and every traced
+ * batch another, so a batch that outlives its Batcher still records
+ * into a live trace. The last unuse() deletes it.
+ *
+ * Dump format, host byte order: a header of the magic "HVPT", then
+ * uint32 version (1), PBATCH_NR_TS and record size, and a uint64 record
+ * count; then the records, oldest first.
+ */
+class PBatchTrace {
+public:
+	struct record {
+		uint64_t tstamps[PBATCH_NR_TS];	// 0 if not stamped
+		uint32_t npkts;
+		uint32_t capacity;
+	};
+
+	PBatchTrace();
+
+	inline void use() { _refcount++; }
+	inline void unuse() {
+		if (_refcount.dec_and_test())
+			delete this;
+	}
+
+	int set_ring_size(uint32_t n);
+	void record_batch(PBatch *pb);
+	void clear();
+
+	String unparse() const;
+	int dump(const String &filename, ErrorHandler *errh) const;
+
+	static const char * const stage_names[PBATCH_NR_TS];
+
+private:
+	HVPHistogram _stages[PBATCH_NR_TS];	// by end point, 0 unused
+	HVPHistogram _total;
+	record *_ring;
+	uint32_t _ring_size;
+	uint64_t _recorded;
+	atomic_uint32_t _refcount;
+
+	~PBatchTrace();
+};
+
+/*
+ * Owner of the device stream of a batch, for streams that are reused by
+ * a scheduler instead of being freed with the batch. Batcher::kill_batch
+ * hands such a stream back through stream_released().
+ */
+class PBatchStreamOwner {
+public:
+	virtual ~PBatchStreamOwner() {}
+	virtual void stream_released(PBatch *pb) = 0;
+};
+
+/*
+ * A memory region that packet data lives in, such as the netmap buffer
+ * memory. Zero-copy batches refer to packets by offset into a registered
+ * region instead of copying slices, and device code gathers packet data
+ * from dbase + offset. dbase is the region's address as seen by the
+ * device, so the region must be mapped for device access.
+ *
+ * Entries live in a fixed table and never move, so pointers to them stay
+ * valid. remove() empties an entry and add() may reuse it later; gen
+ * changes each time, so a holder of a pointer compares gen to tell that
+ * the entry now describes another region. A region must only be removed
+ * once no live batch refers to it.
+ */
+struct PBatchRegion {
+	unsigned char *hbase;
+	unsigned char *dbase;
+	unsigned long size;	// 0 for an empty entry
+	unsigned gen;
+
+	inline bool contains(const unsigned char *p) const {
+		return p >= hbase && p < hbase + size;
+	}
+
+	static int add(void *hbase, void *dbase, unsigned long size);
+	static void remove(void *hbase);
+	static const PBatchRegion *find(const unsigned char *p);
+
+	enum { max_regions = 8 };
+};
+
+/*
+ * Columns of header fields parsed once at batching time, see
+ * PBatch::field_flags. Entry i belongs to packet i. Columns of fields
+ * that were not requested are 0. Addresses and ports are in host byte
+ * order. ihl is the IP header length in bytes, 0 for a packet that is
+ * not IPv4 or is too short to parse, in which case the other fields are
+ * 0 too. l4off is the offset of the transport header from the MAC
+ * header. Ports are 0 for packets other than first fragments of TCP and
+ * UDP.
+ */
+struct PBatchFields {
+	uint32_t *dst_ips;
+	uint32_t *src_ips;
+	uint8_t *protos;
+	uint16_t *sports;
+	uint16_t *dports;
+	uint8_t *ihls;
+	uint16_t *l4offs;
+};
+
 class PBatch {
 public:
 	int capacity;
@@ -47,6 +184,12 @@ public:
 	 *  |                                  |
 	 *  |  N * anno_size: annotation data  |
 	 *  |                                  |
+	 *  |----------------------------------|
+	 *  ~  For roundup to PAGE_SIZE        ~
+	 *  |----------------------------------|
+	 *  |                                  |
+	 *  |  parsed field columns            |
+	 *  |                                  |
 	 *  +----------------------------------+
 	 *
 	 *  Packet lengths data may not be copied if the slice length
@@ -57,6 +200,22 @@ public:
 	 *  Annotation data may also not be copied if anno_flags is
 	 *  0 or for write only. Particularly, if 0, no annotation data
 	 *  are allocated at all.
+	 *
+	 *  Field columns are only allocated for the fields in
+	 *  field_flags, one after another, each aligned to
+	 *  G4C_MEM_ALIGN. A batch with fields and no slice range has
+	 *  no slices, slice_size is 0.
+	 *
+	 *  Zero-copy batches have no slices. The layout is instead:
+	 *
+	 *    N * unsigned int: packet flags
+	 *    N * unsigned int: slice offsets into region
+	 *    N * short: slice lengths, always present
+	 *    N * anno_size: annotation data
+	 *    parsed field columns
+	 *
+	 *  each rounded up to PAGE_SIZE, so that offsets, lengths and
+	 *  annotations are one contiguous work area.
 	 */
 	
 	/*
@@ -68,12 +227,51 @@ public:
 	unsigned char *hslices;
 	unsigned char *hpktannos;
 
+	/*
+	 * Packet flags, set by host elements that process the batch in place:
+	 *   PBATCH_PKT_PORT_MASK: output port chosen for the packet by the last
+	 *                         classifying element, e.g. a route lookup.
+	 *   PBATCH_PKT_DROPPED:   the packet left the batch, it was killed or
+	 *                         pushed out on its own. Its pptrs entry is 0
+	 *                         and later elements must skip the slot.
+	 *   PBATCH_PKT_BAD:       a batch kernel, which only sees slices, found
+	 *                         the packet bad. It is still in pptrs, split()
+	 *                         and DeBatcher kill it.
+	 */
+#define PBATCH_PKT_PORT_MASK ((unsigned int)0x0000ffff)
+#define PBATCH_PKT_DROPPED ((unsigned int)0x80000000)
+#define PBATCH_PKT_BAD ((unsigned int)0x40000000)
+
 	// Device pointers
 	short *dpktlens;
 	unsigned int *dpktflags;
 	unsigned char *dslices;
 	unsigned char *dpktannos;
 
+	/*
+	 * Parsed fields, requested by users with Batcher::set_fields()
+	 * instead of, or besides, a slice range:
+	 *   field_flags: PBATCH_FIELD_* flags of the columns present.
+	 *   hfields, dfields: host and device columns.
+	 *   fields_offset: offset of the columns from hostmem and devmem.
+	 */
+	unsigned char field_flags;
+#define PBATCH_FIELD_DST_IP ((unsigned char)0x01)
+#define PBATCH_FIELD_SRC_IP ((unsigned char)0x02)
+#define PBATCH_FIELD_PROTO ((unsigned char)0x04)
+#define PBATCH_FIELD_PORTS ((unsigned char)0x08)
+#define PBATCH_FIELD_IHL ((unsigned char)0x10)
+#define PBATCH_FIELD_L4_OFF ((unsigned char)0x20)
+	PBatchFields hfields;
+	PBatchFields dfields;
+	unsigned long fields_offset;
+
+	// Zero-copy batches only:
+	bool zero_copy;
+	const PBatchRegion *region;
+	unsigned int *hpktoffs;
+	unsigned int *dpktoffs;
+
 	/*
 	 * Slice is a piece of packet data. A slice is copied from Packet's data to
 	 * page-locked host memory, and copied to device. Each packet has a slice.
@@ -117,38 +315,184 @@ public:
 	 *   hwork_ptr: host side work pointer, for current copy and execution data.
 	 *   dwork_ptr: device side work pointer.
 	 *   work_size: current work data size.
+	 *   stream_owner: who dev_stream goes back to, 0 if it is freed with
+	 *                 the batch.
+	 *   h2d_bytes, d2h_bytes: bytes copied for this batch so far.
 	 */
 	int dev_stream;
+	PBatchStreamOwner *stream_owner;
 	void *hwork_ptr;
 	void *dwork_ptr;
 	int work_size;
+	unsigned long h2d_bytes;
+	unsigned long d2h_bytes;
 
-	// for sharing:
-	int shared;
+	/*
+	 * For sharing:
+	 *   refs: references to the batch, the creator holds the first one.
+	 *         Take one with acquire() for every other holder, e.g. a
+	 *         stage on another RouterThread that still uses the batch
+	 *         after passing it on, and drop it with Batcher::kill_batch,
+	 *         which frees the batch with the last release(). Atomic, so
+	 *         holders may run on different threads.
+	 *   parent: for sub-batches made by split(), the batch whose memory
+	 *           this one refers to. A sub-batch holds a reference on it.
+	 *   row_begin, row_end: the rows of the memory that are this
+	 *           batch's, row_end -1 for all npkts of them. split() gives
+	 *           each part its own run of rows, and copies stay inside
+	 *           it, so the parts can be on the device at once.
+	 *
+	 * With CLICK_DEBUG_PBATCH (--enable-batch-debugging), release() of a
+	 * batch without references is reported as a double kill, and nlive
+	 * counts the batches handed out and not yet freed. Freed batches are
+	 * kept as tombstones for a while so a late kill still finds refs 0,
+	 * and nlive is checked when the router is destroyed.
+	 */
+	atomic_uint32_t refs;
+	PBatch *parent;
+	int row_begin;
+	int row_end;
+#if CLICK_DEBUG_PBATCH
+	static atomic_uint32_t nlive;
+#endif
 	int nr_users;
 	unsigned long user_priv_len;
 	void *user_priv;	
 
+	/*
+	 * For pooled batches:
+	 *   pool: the pool this batch returns to when killed, 0 if not pooled.
+	 *   pool_next: free list link, only valid while sitting in the pool.
+	 */
+	PBatchPool *pool;
+	PBatch *pool_next;
+
+	/*
+	 * For adaptive batching and latency accounting:
+	 *   tflush: steady time the Batcher pushed this batch out, used to
+	 *           measure queue-to-completion latency.
+	 *   trace: where the batch's lifecycle goes, 0 if not traced. The
+	 *          batch holds a reference on it until it is killed.
+	 *   tstamps: cycle stamps indexed by PBATCH_TS_*, see stamp().
+	 */
+	Timestamp tflush;
+	PBatchTrace *trace;
+	click_cycles_t tstamps[PBATCH_NR_TS];
+
 public:
 	// Functions:
 	PBatch();
 	PBatch(int _capacity, int _slice_begin, int _slice_end, bool _force_pktlens,
-	       int _anno_flags, int _anno_length);
+	       int _anno_flags, int _anno_length, bool _zero_copy = false,
+	       int _field_flags = 0);
 	~PBatch();
 	void calculate_parameters();
+	unsigned long set_field_pointers(PBatchFields *f, unsigned char *base, int n);
+	void parse_fields(int idx, const unsigned char *mac, int len);
 	int init_for_host_batching();
 	void clean_for_host_batching();
 	void set_pointers();
+	void set_zero_copy_pointers();
+	PBatch *new_sub_batch();
+
+	enum { max_work_ranges = 10 };
+	int work_ranges(unsigned long *offs, unsigned long *lens);
+	int split(PBatch **outs, int nports);
 	inline bool full() { return npkts >= capacity;}
+	inline int rows_end() { return row_end < 0 ? npkts : row_end; }
 	inline int size() { return npkts; }
+	// Rows this batch carries; less than size() for the parts of a split.
+	inline int nrows() { return rows_end() - row_begin; }
+
+	inline void init_refs();
+	inline void acquire() { refs++; }
+	inline bool release();
 
 	inline unsigned int *hpktflag(int idx) { return hpktflags + idx; }
-	inline unsigned char *hslice(int idx) { return hslices + idx*slice_size;}
+
+	inline void stamp(int point) {
+		if (trace)
+			tstamps[point] = click_get_cycles();
+	}
+	// For the elements that end a batch's life once its packets are out.
+	inline void trace_debatch() {
+		if (trace) {
+			stamp(PBATCH_TS_DEBATCH);
+			trace->record_batch(this);
+		}
+	}
+
+	inline bool dropped(int idx) { return !pptrs[idx]; }
+	// The caller has already killed or pushed the packet.
+	inline void set_dropped(int idx) {
+		pptrs[idx] = 0;
+		hpktflags[idx] |= PBATCH_PKT_DROPPED;
+	}
+	inline bool pkt_bad(int idx) { return hpktflags[idx] & PBATCH_PKT_BAD; }
+	inline int pkt_port(int idx) { return hpktflags[idx] & PBATCH_PKT_PORT_MASK; }
+	inline void set_pkt_port(int idx, int port) {
+		hpktflags[idx] = (hpktflags[idx] & ~PBATCH_PKT_PORT_MASK) | port;
+	}
+
+	/*
+	 * For loops over pptrs: prefetch the Packet objects prefetch_distance
+	 * slots ahead of idx, and the packet data half way there, so both are
+	 * in cache by the time the loop reaches them.
+	 */
+	enum { prefetch_distance = 4 };
+	inline void prefetch(int idx) {
+#ifdef __GNUC__
+		int j = idx + prefetch_distance;
+		if (j < npkts && pptrs[j])
+			__builtin_prefetch(pptrs[j]);
+		j = idx + prefetch_distance/2;
+		if (j < npkts && pptrs[j])
+			__builtin_prefetch(pptrs[j]->data());
+#else
+		(void) idx;
+#endif
+	}
+	// Copy batches only, zero-copy batches use hzslice().
+	inline unsigned char *hslice(int idx) { return hslices + idx*slice_size; }
+	inline unsigned char *hzslice(int idx) { return region->hbase + hpktoffs[idx]; }
 	inline unsigned char *hanno(int idx) { return hpktannos?(hpktannos + idx*anno_size):0;}
 	inline short *hpktlen(int idx) { return hpktlens?(hpktlens + idx):0;}
 
 	inline void *get_user_priv(unsigned long offset) { return (void*)(g4c_ptr_add(user_priv, offset)); }
 };
 
+inline void
+PBatch::init_refs()
+{
+	refs = 1;
+#if CLICK_DEBUG_PBATCH
+	nlive++;
+#endif
+}
+
+/*
+ * Drop a reference, returns true if it was the last one and the caller
+ * must free the batch.
+ */
+inline bool
+PBatch::release()
+{
+#if CLICK_DEBUG_PBATCH
+	uint32_t r;
+	do {
+		r = refs.value();
+		if (r == 0) {
+			click_chatter("PBatch %p: killed with no references left, double kill?", this);
+			return false;
+		}
+	} while (refs.compare_swap(r, r - 1) != r);
+	if (r == 1)
+		nlive--;
+	return r == 1;
+#else
+	return refs.dec_and_test();
+#endif
+}
+
 CLICK_ENDDECLS
 #endif
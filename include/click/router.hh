@@ -82,12 +82,16 @@ class Router { public:
     void*& force_attachment(const String& aname);
     void* set_attachment(const String& aname, void* value);
 
+    typedef void (*CleanupHook)(Router *router, void *user_data);
+    void add_cleanup_hook(CleanupHook hook, void *user_data);
+
     ErrorHandler* chatter_channel(const String& channel_name) const;
     HashMap_ArenaFactory* arena_factory() const;
 
     inline ThreadSched* thread_sched() const;
     inline void set_thread_sched(ThreadSched* scheduler);
     inline int home_thread_id(const Element *e) const;
+    inline void set_home_thread_id(const Element *e, int thread_id);
 
     /** @cond never */
     // Needs to be public for NameInfo, but not useful outside
@@ -270,6 +274,9 @@ class Router { public:
     Vector<String> _attachment_names;
     Vector<void*> _attachments;
 
+    Vector<CleanupHook> _cleanup_hooks;
+    Vector<void*> _cleanup_hook_data;
+
     Element* _root_element;
     String _configuration;
 
@@ -452,6 +459,18 @@ Router::home_thread_id(const Element *e) const
 	return hard_home_thread_id(e);
 }
 
+/** @brief Set the home thread of @a e.
+ *
+ * Only meaningful while the router is being configured and initialized,
+ * before @a e's tasks and file descriptors are set up; an element may call
+ * it from its configure(), e.g. to stay on the thread that serves its
+ * device queue. Overrides the ThreadSched. */
+inline void
+Router::set_home_thread_id(const Element *e, int thread_id)
+{
+    _element_home_thread_ids[e->eindex() + 1] = thread_id;
+}
+
 /** @cond never */
 /** @brief  Return the NameInfo object for this router, if it exists.
  *
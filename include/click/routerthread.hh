@@ -25,6 +25,37 @@ CLICK_CXX_UNPROTECT
 // dependency.
 CLICK_DECLS
 
+#if HAVE_MULTITHREAD
+/** @class TaskStealDeque
+ * @brief Bounded lock-free deque of Tasks offered to idle threads.
+ *
+ * Each RouterThread owns one.  The owning thread push()es and pop()s at the
+ * bottom; any thread may steal() from the top.  Indexes follow Chase and
+ * Lev.  A slot is emptied by atomic exchange, so whoever removes a Task
+ * pointer from a slot -- owner, thief, or retract() -- owns that Task's
+ * offer until it clears Task::_steal_offered.  Offers may be stale; users
+ * check the Task's status before acting on it. */
+class TaskStealDeque { public:
+
+    enum { capacity = 64 };
+
+    inline TaskStealDeque();
+
+    inline unsigned size() const;
+    inline bool push(Task *t);
+    inline bool pop(Task *&t);
+    inline bool steal(Task *&t);
+    inline bool retract(Task *t);
+
+  private:
+
+    atomic_uint32_t _top;
+    volatile uint32_t _bottom;
+    Task * volatile _slot[capacity];
+
+};
+#endif
+
 class RouterThread : private TaskLink { public:
 
     enum { THREAD_QUIESCENT = -1, THREAD_UNKNOWN = -1000 };
@@ -60,6 +91,17 @@ class RouterThread : private TaskLink { public:
 
     void kill_router(Router *router);
 
+#if HAVE_MULTITHREAD
+    /** @brief Return the number of tasks this thread has stolen. */
+    uint32_t steals() const		{ return _steals; }
+    /** @brief Return the number of times this thread tried to steal. */
+    uint32_t steal_attempts() const	{ return _steal_attempts; }
+    /** @brief Return the number of tasks stolen from this thread. */
+    uint32_t stolen() const		{ return _stolen.value(); }
+    /** @brief Return the number of tasks this thread offered to thieves. */
+    uint32_t steal_offers() const	{ return _steal_offers; }
+#endif
+
 #if HAVE_ADAPTIVE_SCHEDULER
     // min_cpu_share() and max_cpu_share() are expressed on a scale with
     // Task::MAX_UTILIZATION == 100%.
@@ -78,11 +120,31 @@ class RouterThread : private TaskLink { public:
 
 #if CLICK_USERLEVEL
     inline void run_signals();
+
+    // Idle policy: once out of tasks, poll for idle_spin(), then poll and
+    // yield the CPU for idle_yield(), then block.
+    enum { IDLE_SPIN, IDLE_YIELD, IDLE_BLOCK, NIDLE };
+    Timestamp idle_spin() const		{ return _idle_spin_max; }
+    Timestamp idle_spin_current() const	{ return _idle_spin; }
+    Timestamp idle_yield() const	{ return _idle_yield; }
+    bool idle_adaptive() const		{ return _idle_adaptive; }
+    void set_idle_policy(const Timestamp &spin, const Timestamp &yield,
+			 bool adaptive);
+    Timestamp idle_time(int phase) const {
+	assert(phase >= 0 && phase < NIDLE);
+	return _idle_time[phase];
+    }
+    uint64_t idle_wakeups(int phase) const {
+	assert(phase >= 0 && phase < NIDLE);
+	return _idle_wakeups[phase];
+    }
+    inline bool select_nonblocking() const;
 #endif
 
     enum { S_PAUSED, S_BLOCKED, S_TIMERWAIT,
 	   S_LOCKSELECT, S_LOCKTASKS,
 	   S_RUNTASK, S_RUNTIMER, S_RUNSIGNAL, S_RUNPENDING, S_RUNSELECT,
+	   S_SPIN, S_YIELD,
 	   NSTATES };
     inline void set_thread_state(int state);
     inline void set_thread_state_for_blocking(int delay_type);
@@ -133,6 +195,14 @@ class RouterThread : private TaskLink { public:
 #endif
 #if HAVE_MULTITHREAD && !CLICK_LINUXMODULE
     click_processor_t _running_processor;
+#endif
+#if HAVE_MULTITHREAD
+    TaskStealDeque _steal_deque;
+    volatile bool _steal_idle;
+    uint32_t _steals;
+    uint32_t _steal_attempts;
+    uint32_t _steal_offers;
+    atomic_uint32_t _stolen;
 #endif
     Spinlock _task_lock;
     atomic_uint32_t _task_blocker;
@@ -147,6 +217,21 @@ class RouterThread : private TaskLink { public:
     bool _greedy;
 #endif
 
+#if CLICK_USERLEVEL
+    Timestamp _idle_spin;		// current spin limit
+    Timestamp _idle_spin_max;		// configured spin limit
+    Timestamp _idle_yield;
+    bool _idle_adaptive;
+    int _idle_phase;			// -1 while not idle
+    Timestamp _idle_since;
+    Timestamp _idle_phase_start;
+    Timestamp _idle_time[NIDLE];
+    uint64_t _idle_wakeups[NIDLE];
+    unsigned _idle_spin_hits;		// for the adaptive spin limit
+    unsigned _idle_spin_near;
+    unsigned _idle_spin_misses;
+#endif
+
 #if CLICK_BSDMODULE
     // XXX FreeBSD
     u_int64_t _old_tsc; /* MARKO - temp. */
@@ -208,12 +293,23 @@ class RouterThread : private TaskLink { public:
     inline void run_tasks(int ntasks);
     inline void process_pending();
     inline void run_os();
+#if CLICK_USERLEVEL
+    void update_idle_phase();
+    void end_idle();
+    void adapt_idle_spin();
+#endif
 #if HAVE_ADAPTIVE_SCHEDULER
     void client_set_tickets(int client, int tickets);
     inline void client_update_pass(int client, const Timestamp &before);
 #endif
 #if HAVE_TASK_HEAP
     void task_reheapify_from(int pos, Task*);
+#endif
+#if HAVE_MULTITHREAD
+    void offer_task(Task *t);
+    void withdraw_offers();
+    RouterThread *steal_victim() const;
+    bool steal_task();
 #endif
     inline bool current_thread_is_running() const;
     void request_stop();
@@ -461,9 +557,122 @@ RouterThread::set_thread_state_for_blocking(int delay_type)
 {
     if (delay_type < 0)
 	set_thread_state(S_BLOCKED);
+    else if (delay_type)
+	set_thread_state(S_TIMERWAIT);
+#if CLICK_USERLEVEL
+    else if (_idle_phase == IDLE_SPIN)
+	set_thread_state(S_SPIN);
+    else if (_idle_phase == IDLE_YIELD)
+	set_thread_state(S_YIELD);
+#endif
     else
-	set_thread_state(delay_type ? S_TIMERWAIT : S_PAUSED);
+	set_thread_state(S_PAUSED);
+}
+
+#if CLICK_USERLEVEL
+/** @brief Return true iff the thread should poll rather than block.
+ *
+ * True if tasks are scheduled, or if the thread is idle but still within
+ * the spin or yield phases of its idle policy. */
+inline bool
+RouterThread::select_nonblocking() const
+{
+    return active() || (_idle_phase >= 0 && _idle_phase != IDLE_BLOCK);
+}
+#endif
+
+#if HAVE_MULTITHREAD
+inline
+TaskStealDeque::TaskStealDeque()
+    : _bottom(0)
+{
+    _top = 0;
+    for (int i = 0; i < capacity; ++i)
+	_slot[i] = 0;
+}
+
+/** @brief Return the number of offers in the deque.
+ *
+ * The result may be stale by the time it is returned. */
+inline unsigned
+TaskStealDeque::size() const
+{
+    int32_t n = _bottom - _top.value();
+    return n > 0 ? n : 0;
+}
+
+/** @brief Push @a t at the bottom.  Only the owning thread may call this.
+ *
+ * Returns false if the deque is full. */
+inline bool
+TaskStealDeque::push(Task *t)
+{
+    uint32_t b = _bottom;
+    if (b - _top.value() >= (uint32_t) capacity
+	// a thief may not have emptied its claimed slot yet
+	|| !__sync_bool_compare_and_swap(&_slot[b % capacity], (Task *) 0, t))
+	return false;
+    click_fence();
+    _bottom = b + 1;
+    return true;
+}
+
+/** @brief Pop from the bottom.  Only the owning thread may call this.
+ *
+ * Returns false if the deque is empty.  Otherwise sets @a t to the popped
+ * offer, which is null if it was retracted. */
+inline bool
+TaskStealDeque::pop(Task *&t)
+{
+    uint32_t b = _bottom - 1;
+    _bottom = b;
+    click_fence();
+    uint32_t top = _top.value();
+    if ((int32_t) (b - top) < 0) {
+	_bottom = top;
+	return false;
+    } else if (b == top) {
+	// last offer: race thieves for it
+	bool won = _top.compare_swap(top, top + 1) == top;
+	_bottom = top + 1;
+	if (!won)
+	    return false;
+    }
+    t = __sync_lock_test_and_set(&_slot[b % capacity], (Task *) 0);
+    return true;
+}
+
+/** @brief Steal from the top.  Any thread may call this.
+ *
+ * Returns false if the deque was empty or another thread won the race.
+ * Otherwise sets @a t to the stolen offer, which is null if it was
+ * retracted. */
+inline bool
+TaskStealDeque::steal(Task *&t)
+{
+    uint32_t top = _top.value();
+    click_fence();
+    uint32_t b = _bottom;
+    if ((int32_t) (b - top) <= 0
+	|| _top.compare_swap(top, top + 1) != top)
+	return false;
+    t = __sync_lock_test_and_set(&_slot[top % capacity], (Task *) 0);
+    return true;
+}
+
+/** @brief Remove any offer of @a t.  Any thread may call this.
+ *
+ * Returns true if an offer was removed. */
+inline bool
+TaskStealDeque::retract(Task *t)
+{
+    for (int i = 0; i < capacity; ++i)
+	if (_slot[i] == t
+	    && __sync_bool_compare_and_swap(&_slot[i], t, (Task *) 0))
+	    return true;
+    return false;
 }
+#endif
 
 #if CLICK_DEBUG_SCHEDULING > 1
 inline Timestamp
@@ -7,7 +7,7 @@
 #include <click/vector.hh>
 #include <click/sync.hh>
 #include <unistd.h>
-#if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_POLL && !HAVE_ALLOW_KQUEUE
+#if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_POLL && !HAVE_ALLOW_KQUEUE && !HAVE_ALLOW_EPOLL
 # define HAVE_ALLOW_SELECT 1
 #endif
 #if defined(__APPLE__) && HAVE_ALLOW_SELECT && HAVE_ALLOW_POLL
@@ -18,16 +18,22 @@
 # include <poll.h>
 #else
 # undef HAVE_ALLOW_POLL
-# if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_KQUEUE
+# if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_KQUEUE && !HAVE_ALLOW_EPOLL
 #  error "poll is not supported on this system, try --enable-select"
 # endif
 #endif
 #if !HAVE_SYS_EVENT_H || !HAVE_KQUEUE
 # undef HAVE_ALLOW_KQUEUE
-# if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_POLL
+# if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_POLL && !HAVE_ALLOW_EPOLL
 #  error "kqueue is not supported on this system, try --enable-select"
 # endif
 #endif
+#if !HAVE_SYS_EPOLL_H || !HAVE_EPOLL_CREATE
+# undef HAVE_ALLOW_EPOLL
+# if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_POLL && !HAVE_ALLOW_KQUEUE
+#  error "epoll is not supported on this system, try --enable-select"
+# endif
+#endif
 CLICK_DECLS
 class Element;
 class Router;
@@ -59,8 +65,10 @@ class SelectSet { public:
 	Element *read;
 	Element *write;
 	int pollfd;
+	bool edge;
+	bool noepoll;
 	SelectorInfo()
-	    : read(0), write(0), pollfd(-1)
+	    : read(0), write(0), pollfd(-1), edge(false), noepoll(false)
 	{
 	}
     };
@@ -70,6 +78,10 @@ class SelectSet { public:
 #if HAVE_ALLOW_KQUEUE
     int _kqueue;
 #endif
+#if HAVE_ALLOW_EPOLL
+    int _epoll;
+    Vector<int> _noepoll_fds;
+#endif
 #if !HAVE_ALLOW_POLL
     struct pollfd {
 	int fd;
@@ -86,13 +98,19 @@ class SelectSet { public:
     click_processor_t _select_processor;
 #endif
 
-    void register_select(int fd, bool add_read, bool add_write);
+    int register_select(int fd, bool add_read, bool add_write,
+			bool edge = false);
     void remove_pollfd(int pi, int event);
     inline void call_selected(int fd, int mask) const;
     inline bool post_select(RouterThread *thread, bool acquire);
 #if HAVE_ALLOW_KQUEUE
     void run_selects_kqueue(RouterThread *thread);
 #endif
+#if HAVE_ALLOW_EPOLL
+    int update_epoll(int fd, int old_events);
+    void remove_noepoll(int fd);
+    void run_selects_epoll(RouterThread *thread);
+#endif
 #if HAVE_ALLOW_POLL
     void run_selects_poll(RouterThread *thread);
 #else
@@ -55,6 +55,7 @@ class Task : private TaskLink { public:
 #if HAVE_ADAPTIVE_SCHEDULER
     enum { MAX_UTILIZATION = 1000 };
 #endif
+    enum { MAX_CHARGE = 1 << 12 };
 
     /** @brief Construct a task that calls @a f with @a user_data argument.
      *
@@ -250,6 +251,23 @@ class Task : private TaskLink { public:
      */
     void move_thread(int new_thread_id);
 
+    /** @brief Return true iff the task may be stolen by an idle thread.
+     *
+     * When the Master has work stealing enabled, a thread that runs out of
+     * tasks may take a migratable task that is waiting to run on a busier
+     * thread, changing the task's home thread as if by move_thread().
+     * Tasks are not migratable by default; the router's ThreadSched
+     * decides the initial value.
+     * @sa set_migratable, Master::set_work_stealing */
+    inline bool migratable() const;
+
+    /** @brief Set whether the task may be stolen by an idle thread.
+     *
+     * Only mark a task migratable if its callback is safe to run on any
+     * thread.  Has no effect in single-threaded builds.
+     * @sa migratable */
+    inline void set_migratable(bool migratable);
+
 
 #if HAVE_STRIDE_SCHED
     inline int tickets() const;
@@ -257,6 +275,24 @@ class Task : private TaskLink { public:
     inline void adjust_tickets(int delta);
 #endif
 
+    /** @brief Charge the current run for @a work units of work.
+     *
+     * Call from the task's callback to report how much work this run
+     * did, usually the number of packets moved; a callback that moves a
+     * 1024-packet batch should charge 1024.  Repeated calls add up.  A
+     * run that returns true without charging counts as 1 unit.
+     *
+     * The RouterThread advances the task's stride pass by its stride
+     * times the charge, so a task that moves a batch per run gets the
+     * same CPU share as one that moves a packet per run at equal tickets.
+     * The charge also counts against the number of tasks the thread runs
+     * between checks for timers and file descriptors, so a thread running
+     * batched tasks checks them as often, per packet, as one running
+     * per-packet tasks.  Charges above MAX_CHARGE are capped. */
+    inline void charge(unsigned work) {
+	_charge += work;
+    }
+
     inline bool fire();
 
 #if HAVE_ADAPTIVE_SCHEDULER
@@ -298,6 +334,7 @@ class Task : private TaskLink { public:
 
     TaskCallback _hook;
     void *_thunk;
+    unsigned _charge;
 
 #if HAVE_ADAPTIVE_SCHEDULER
     unsigned _runs;
@@ -306,6 +343,8 @@ class Task : private TaskLink { public:
 #if HAVE_MULTITHREAD
     DirectEWMA _cycles;
     unsigned _cycle_runs;
+    bool _migratable;
+    volatile bool _steal_offered;
 #endif
 
     RouterThread *_thread;
@@ -368,12 +407,12 @@ Task::Task(TaskCallback f, void *user_data)
 #if HAVE_STRIDE_SCHED
       _stride(0), _tickets(-1),
 #endif
-      _hook(f), _thunk(user_data),
+      _hook(f), _thunk(user_data), _charge(0),
 #if HAVE_ADAPTIVE_SCHEDULER
       _runs(0), _work_done(0),
 #endif
 #if HAVE_MULTITHREAD
-      _cycle_runs(0),
+      _cycle_runs(0), _migratable(false), _steal_offered(false),
 #endif
       _thread(0), _owner(0), _pending_nextptr(0)
 {
@@ -390,12 +429,12 @@ Task::Task(Element* e)
 #if HAVE_STRIDE_SCHED
       _stride(0), _tickets(-1),
 #endif
-      _hook(0), _thunk(e),
+      _hook(0), _thunk(e), _charge(0),
 #if HAVE_ADAPTIVE_SCHEDULER
       _runs(0), _work_done(0),
 #endif
 #if HAVE_MULTITHREAD
-      _cycle_runs(0),
+      _cycle_runs(0), _migratable(false), _steal_offered(false),
 #endif
       _thread(0), _owner(0), _pending_nextptr(0)
 {
@@ -449,6 +488,26 @@ Task::thread() const
     return _thread;
 }
 
+inline bool
+Task::migratable() const
+{
+#if HAVE_MULTITHREAD
+    return _migratable;
+#else
+    return false;
+#endif
+}
+
+inline void
+Task::set_migratable(bool migratable)
+{
+#if HAVE_MULTITHREAD
+    _migratable = migratable;
+#else
+    (void) migratable;
+#endif
+}
+
 inline void
 Task::remove_from_scheduled_list()
 {
@@ -608,6 +667,7 @@ Task::fire()
 #if HAVE_MULTITHREAD
     _cycle_runs++;
 #endif
+    _charge = 0;
     bool work_done;
     if (!_hook)
 	work_done = ((Element*)_thunk)->run_task(this);
@@ -104,6 +104,24 @@ class Timer { public:
 	return _schedpos1 != 0;
     }
 
+    /** @brief Return true iff the Timer is coarse.
+     * @sa set_coarse() */
+    inline bool coarse() const {
+	return _coarse;
+    }
+
+    /** @brief Set whether the Timer is coarse.
+     *
+     * A coarse timer is kept in its thread's timing wheel instead of the
+     * timer heap, so scheduling and unscheduling it take @e O(1) time.  In
+     * exchange, it fires up to one wheel tick after its expiry (see
+     * TimerSet::wheel_granularity(); 1 ms by default).  Coarse timers suit
+     * large numbers of approximate timeouts, such as per-flow expirations.
+     * The change takes effect the next time the timer is scheduled. */
+    inline void set_coarse(bool coarse) {
+	_coarse = coarse;
+    }
+
 
     /** @brief Return the Timer's steady-clock expiration time.
      *
@@ -339,6 +357,7 @@ class Timer { public:
   private:
 
     int _schedpos1;
+    bool _coarse;
     Timestamp _expiry_s;
     union {
 	TimerCallback callback;
@@ -346,6 +365,8 @@ class Timer { public:
     void *_thunk;
     Element *_owner;
     RouterThread *_thread;
+    Timer *_wheel_next;
+    Timer **_wheel_pprev;
 
     Timer &operator=(const Timer &x);
 
@@ -25,6 +25,10 @@ class TimerSet { public:
     unsigned timer_stride() const		{ return _timer_stride; }
     void set_max_timer_stride(unsigned timer_stride);
 
+    Timestamp wheel_granularity() const;
+    void set_wheel_granularity(const Timestamp &granularity);
+    unsigned wheel_timer_count() const		{ return _wheel_count; }
+
     void kill_router(Router *router);
 
     void run_timers(RouterThread *thread, Master *master);
@@ -54,6 +58,17 @@ class TimerSet { public:
 	}
     };
 
+    // Coarse timers live in a hierarchical timing wheel.  Level L slot S
+    // holds timers whose expiry tick has S in bits [8L, 8L+8) and is less
+    // than 256^(L+1) ticks away; higher levels cascade down as time passes,
+    // a level L slot at the first tick that is a multiple of 256^L and has
+    // S in those bits.
+    // A wheel timer's _schedpos1 is wheel_schedpos1 plus its level, or plus
+    // wheel_levels while it waits to run.
+    enum { wheel_bits = 8, wheel_size = 1 << wheel_bits,
+	   wheel_mask = wheel_size - 1, wheel_levels = 4,
+	   wheel_schedpos1 = 0x40000000 };
+
     // Most likely _timer_expiry now fits in a cache line
     Timestamp _timer_expiry CLICK_ALIGNED(8);
 
@@ -71,6 +86,14 @@ class TimerSet { public:
     Timestamp _timer_check;
     uint32_t _timer_check_reports;
 
+    Timer *_wheel[wheel_levels][wheel_size];
+    uint64_t _wheel_occupied[wheel_levels][wheel_size / 64];	// nonempty slots
+    unsigned _wheel_level_count[wheel_levels];
+    unsigned _wheel_count;
+    uint32_t _wheel_granularity;		// usec per tick
+    uint64_t _wheel_tick;			// next tick to expire
+    Timestamp _wheel_expiry;
+
     inline void run_one_timer(Timer *);
 
     void set_timer_expiry() {
@@ -78,9 +101,20 @@ class TimerSet { public:
 	    _timer_expiry = _timer_heap.at_u(0).expiry_s;
 	else
 	    _timer_expiry = Timestamp();
+	if (_wheel_count && (!_timer_expiry || _wheel_expiry < _timer_expiry))
+	    _timer_expiry = _wheel_expiry;
     }
     void check_timer_expiry(Timer *t);
 
+    inline uint64_t wheel_expiry_tick(Timer *t) const;
+    int wheel_next_slot(int level, int idx) const;
+    uint64_t wheel_next_tick() const;
+    void set_wheel_expiry();
+    void wheel_insert(Timer *t);
+    void wheel_remove(Timer *t);
+    void wheel_cascade(int level, int slot);
+    void run_wheel(RouterThread *thread);
+
     inline void lock_timers();
     inline bool attempt_lock_timers();
     inline void unlock_timers();
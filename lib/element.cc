@@ -1708,16 +1708,28 @@ Element::selected(int fd)
 /** @brief Register interest in @a mask events on file descriptor @a fd.
  *
  * @param fd the file descriptor
- * @param mask relevant events: bitwise-or of one or more of SELECT_READ, SELECT_WRITE
+ * @param mask relevant events: bitwise-or of one or more of SELECT_READ,
+ * SELECT_WRITE, and optionally SELECT_EDGE
  *
  * Click will register interest in readability and/or writability on file
  * descriptor @a fd.  When @a fd is ready, Click will call this element's
  * selected(@a fd, @a mask) method.
  *
+ * If @a mask includes SELECT_EDGE and Click waits with epoll(), @a fd is
+ * registered edge-triggered: selected() is called when @a fd becomes ready,
+ * not for as long as it stays ready, so the element must drain @a fd each
+ * time.  The flag applies to every event registered on @a fd and lasts until
+ * all of them are removed.  Other wait mechanisms ignore it, and so do file
+ * descriptors epoll() refuses, such as regular files; those are checked
+ * with poll() next to the epoll() wait.
+ *
  * add_select(@a fd, @a mask) overrides any previous add_select() for the same
  * @a fd and events in @a mask.  However, different elements may register
  * interest in different events for the same @a fd.
  *
+ * Returns 0 on success and a negative value if another element already
+ * selects @a fd for one of these events, or if @a fd is not open.
+ *
  * @note Only available at user level.
  *
  * @note Selecting for writability with SELECT_WRITE normally requires more
@@ -39,7 +39,7 @@ extern "C" { static void sighandler(int signo); }
 #endif
 
 Master::Master(int nthreads)
-    : _routers(0)
+    : _work_stealing(false), _routers(0)
 {
     _refcount = 0;
     _master_paused = 0;
@@ -34,6 +34,7 @@ CLICK_DECLS
 atomic_uint32_t NotifierSignal::static_value;
 const char Notifier::EMPTY_NOTIFIER[] = "empty";
 const char Notifier::FULL_NOTIFIER[] = "full";
+const char Notifier::IDLE_NOTIFIER[] = "idle";
 
 /** @file notifier.hh
  * @brief Support for activity signals.
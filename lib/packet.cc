@@ -23,8 +23,14 @@
 #include <click/packet_anno.hh>
 #include <click/glue.hh>
 #include <click/sync.hh>
+#include <click/straccum.hh>
+#include <click/vector.hh>
 #if CLICK_USERLEVEL
 # include <unistd.h>
+# include <sys/syscall.h>
+#endif
+#if CLICK_USERLEVEL && ALLOW_MMAP
+# include <sys/mman.h>
 #endif
 CLICK_DECLS
 
@@ -228,28 +234,92 @@ Packet::~Packet()
 #  define CLICK_PACKET_POOL_BUFSIZ		2048
 #  define CLICK_PACKET_POOL_SIZE		1000 // see LIMIT in packetpool-01.testie
 #  define CLICK_GLOBAL_PACKET_POOL_COUNT	16
+#  define CLICK_PACKET_POOL_NODES		8
+#  if CLICK_USERLEVEL && ALLOW_MMAP
+#   define CLICK_PACKET_POOL_SLABS		1
+#   define CLICK_PACKET_POOL_SLABSIZ		(2 << 20)
+#   define CLICK_PACKET_POOL_SLABHDR		64
+#  endif
+
+/*
+ * Each thread allocates from and frees to its own pool: a magazine (a
+ * chain of up to CLICK_PACKET_POOL_SIZE) of packet headers, and one of
+ * buffers per buffer length. A thread that frees onto a full magazine
+ * hands it to its NUMA node's depot, and a thread whose magazine runs
+ * out takes a full one, from its own node's depot if it can and from
+ * another node's otherwise. Depot slots change hands with one atomic
+ * operation, so threads that free packets allocated elsewhere never wait
+ * for each other.
+ *
+ * With huge pages, the pool carves its buffers out of slabs that it maps
+ * itself, one magazine per slab, and keeps them until static_cleanup().
+ * The allocating thread links a new slab's buffers, so that the pages are
+ * first touched, and placed, on its own node. Every huge page of a slab
+ * starts with a header naming that node, and a thread that frees a
+ * buffer from another node collects it in a magazine for that node's
+ * depot, so buffers go back to where their memory is.
+ */
 namespace {
+enum { pool_normal = 0, pool_jumbo = 1, pool_nclasses = 2 };
 struct PacketData {
     PacketData *next;
-#  if HAVE_MULTITHREAD
     PacketData *pool_next;
-#  endif
 };
 struct PacketPool {
     WritablePacket *p;
     unsigned pcount;
-    PacketData *pd;
-    unsigned pdcount;
+    PacketData *pd[pool_nclasses];
+    unsigned pdcount[pool_nclasses];
+    PacketData *spill[pool_nclasses];	// full magazines, huge pages only
+    uint64_t hits;			// packet headers
+    uint64_t misses;
+    uint64_t buffer_hits;		// data buffers
+    uint64_t buffer_misses;
+    uint64_t refills;
+    uint64_t steals;
 #  if HAVE_MULTITHREAD
+    int id;
+    int node;
     PacketPool *chain;
+#   if CLICK_PACKET_POOL_SLABS
+    // buffers freed here whose slab is on another node
+    PacketData *remote[CLICK_PACKET_POOL_NODES][pool_nclasses];
+    unsigned remotecount[CLICK_PACKET_POOL_NODES][pool_nclasses];
+#   endif
 #  endif
 };
+#  if CLICK_PACKET_POOL_SLABS
+// At the start of each huge page of a slab; next and size are only set in
+// the first one.
+struct PacketSlab {
+    PacketSlab *next;
+    size_t size;
+    int node;
+};
+#  endif
 }
+
+static uint32_t pool_bufsiz[pool_nclasses] = { CLICK_PACKET_POOL_BUFSIZ, 0 };
+static bool pool_hugepages;
+
 #  if HAVE_MULTITHREAD
 static __thread PacketPool *thread_packet_pool;
 static PacketPool *all_thread_packet_pools;
-static PacketPool global_packet_pool;
+static int npacket_pools;
+static int npacket_pool_nodes = 1;
 static volatile uint32_t global_packet_pool_lock;
+static void * volatile packet_depot[CLICK_PACKET_POOL_NODES][1 + pool_nclasses][CLICK_GLOBAL_PACKET_POOL_COUNT];
+
+static int
+current_numa_node()
+{
+#   if CLICK_USERLEVEL && defined(SYS_getcpu)
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, (void *) 0) == 0)
+	return node % CLICK_PACKET_POOL_NODES;
+#   endif
+    return 0;
+}
 
 static inline PacketPool *
 get_packet_pool()
@@ -257,8 +327,12 @@ get_packet_pool()
     PacketPool *pp = thread_packet_pool;
     if (!pp && (pp = new PacketPool)) {
 	memset(pp, 0, sizeof(PacketPool));
+	pp->node = current_numa_node();
 	while (atomic_uint32_t::swap(global_packet_pool_lock, 1) == 1)
 	    /* do nothing */;
+	pp->id = npacket_pools++;
+	if (pp->node >= npacket_pool_nodes)
+	    npacket_pool_nodes = pp->node + 1;
 	pp->chain = all_thread_packet_pools;
 	all_thread_packet_pools = pp;
 	thread_packet_pool = pp;
@@ -267,49 +341,253 @@ get_packet_pool()
     }
     return pp;
 }
+
+// Depot slot kinds: packet headers, then buffers of each length.
+enum { depot_packets = 0, depot_data = 1 };
+
+static bool
+depot_put(int node, int kind, void *magazine)
+{
+    void * volatile *slot = packet_depot[node][kind];
+    for (int i = 0; i < CLICK_GLOBAL_PACKET_POOL_COUNT; ++i)
+	if (!slot[i] && __sync_bool_compare_and_swap(&slot[i], (void *) 0, magazine))
+	    return true;
+    return false;
+}
+
+static void *
+depot_take(PacketPool &pp, int kind)
+{
+    for (int n = 0; n < npacket_pool_nodes; ++n) {
+	void * volatile *slot = packet_depot[(pp.node + n) % npacket_pool_nodes][kind];
+	for (int i = 0; i < CLICK_GLOBAL_PACKET_POOL_COUNT; ++i)
+	    if (slot[i])
+		if (void *magazine = __sync_lock_test_and_set(&slot[i], (void *) 0)) {
+		    ++(n ? pp.steals : pp.refills);
+		    return magazine;
+		}
+    }
+    return 0;
+}
 #  else
 static PacketPool packet_pool;
+
+static inline PacketPool *
+get_packet_pool()
+{
+    return &packet_pool;
+}
 #  endif
 
-WritablePacket *
-WritablePacket::pool_allocate(bool with_data)
+static inline int
+pool_class(size_t length)
 {
-#  if HAVE_MULTITHREAD
-    PacketPool &packet_pool = *get_packet_pool();
-    if ((!packet_pool.p && global_packet_pool.p)
-	|| (with_data && !packet_pool.pd && global_packet_pool.pd)) {
-	while (atomic_uint32_t::swap(global_packet_pool_lock, 1) == 1)
-	    /* do nothing */;
+    if (length == pool_bufsiz[pool_normal])
+	return pool_normal;
+    else if (length == pool_bufsiz[pool_jumbo])
+	return pool_jumbo;
+    else
+	return -1;
+}
 
-	WritablePacket *pp;
-	if (!packet_pool.p && (pp = global_packet_pool.p)) {
-	    global_packet_pool.p = static_cast<WritablePacket *>(pp->prev());
-	    --global_packet_pool.pcount;
-	    packet_pool.p = pp;
-	    packet_pool.pcount = CLICK_PACKET_POOL_SIZE;
+#  if CLICK_PACKET_POOL_SLABS
+static PacketSlab *pool_slabs;
+static unsigned pool_slab_buffers;
+
+static PacketData *
+pool_allocate_slab(PacketPool &pp, int cls)
+{
+    static bool warned;
+    size_t stride = (pool_bufsiz[cls] + 63) & ~(size_t) 63;
+    size_t per_page = (CLICK_PACKET_POOL_SLABSIZ - CLICK_PACKET_POOL_SLABHDR) / stride;
+    size_t size = CLICK_PACKET_POOL_SLABSIZ
+	* ((CLICK_PACKET_POOL_SIZE + per_page - 1) / per_page);
+
+    unsigned char *m = reinterpret_cast<unsigned char *>(MAP_FAILED);
+#   ifdef MAP_HUGETLB
+    m = reinterpret_cast<unsigned char *>(
+	mmap(0, size, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0));
+#   endif
+    if (m == MAP_FAILED) {
+	if (!warned) {
+	    click_chatter("packet pool: no huge pages, using normal pages");
+	    warned = true;
 	}
+	// Align by hand, buffers find their page header by masking.
+	m = reinterpret_cast<unsigned char *>(
+	    mmap(0, size + CLICK_PACKET_POOL_SLABSIZ, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (m == MAP_FAILED)
+	    return 0;
+	size_t skip = -reinterpret_cast<uintptr_t>(m) & (CLICK_PACKET_POOL_SLABSIZ - 1);
+	if (skip)
+	    munmap(m, skip);
+	munmap(m + skip + size, CLICK_PACKET_POOL_SLABSIZ - skip);
+	m += skip;
+    }
 
-	PacketData *pd;
-	if (with_data && !packet_pool.pd && (pd = global_packet_pool.pd)) {
-	    global_packet_pool.pd = pd->pool_next;
-	    --global_packet_pool.pdcount;
-	    packet_pool.pd = pd;
-	    packet_pool.pdcount = CLICK_PACKET_POOL_SIZE;
+    int node = 0;
+#   if HAVE_MULTITHREAD
+    node = pp.node;
+#   else
+    (void) pp;
+#   endif
+    PacketData *pd = 0, **tailp = &pd;
+    int left = CLICK_PACKET_POOL_SIZE;
+    for (unsigned char *page = m; left > 0; page += CLICK_PACKET_POOL_SLABSIZ) {
+	reinterpret_cast<PacketSlab *>(page)->node = node;
+	unsigned char *buf = page + CLICK_PACKET_POOL_SLABHDR;
+	for (size_t i = 0; i < per_page && left > 0; ++i, --left, buf += stride) {
+	    *tailp = reinterpret_cast<PacketData *>(buf);
+	    tailp = &(*tailp)->next;
 	}
+    }
+    *tailp = 0;
+
+    PacketSlab *slab = reinterpret_cast<PacketSlab *>(m);
+    slab->size = size;
+#   if HAVE_MULTITHREAD
+    while (atomic_uint32_t::swap(global_packet_pool_lock, 1) == 1)
+	/* do nothing */;
+#   endif
+    slab->next = pool_slabs;
+    pool_slabs = slab;
+    pool_slab_buffers += CLICK_PACKET_POOL_SIZE;
+#   if HAVE_MULTITHREAD
+    click_compiler_fence();
+    global_packet_pool_lock = 0;
+#   endif
+    return pd;
+}
 
-	click_compiler_fence();
-	global_packet_pool_lock = 0;
+#   if HAVE_MULTITHREAD
+static inline int
+pool_slab_node(unsigned char *data)
+{
+    uintptr_t page = reinterpret_cast<uintptr_t>(data) & ~(uintptr_t) (CLICK_PACKET_POOL_SLABSIZ - 1);
+    return reinterpret_cast<PacketSlab *>(page)->node;
+}
+
+static void
+pool_recycle_remote(PacketPool &pp, PacketData *pd, int cls, int node)
+{
+    pd->next = pp.remote[node][cls];
+    pp.remote[node][cls] = pd;
+    if (++pp.remotecount[node][cls] == CLICK_PACKET_POOL_SIZE) {
+	if (!depot_put(node, depot_data + cls, pd)) {
+	    // that node's depot is full, use them here
+	    pd->pool_next = pp.spill[cls];
+	    pp.spill[cls] = pd;
+	}
+	pp.remote[node][cls] = 0;
+	pp.remotecount[node][cls] = 0;
     }
-#  else
-    (void) with_data;
+}
+#   endif
 #  endif
 
-    WritablePacket *p = packet_pool.p;
+static void
+pool_recycle_data(PacketPool &pp, unsigned char *data, int cls)
+{
+#  if HAVE_MULTITHREAD && CLICK_PACKET_POOL_SLABS
+    if (pool_hugepages && npacket_pool_nodes > 1) {
+	int node = pool_slab_node(data);
+	if (node != pp.node) {
+	    pool_recycle_remote(pp, reinterpret_cast<PacketData *>(data), cls, node);
+	    return;
+	}
+    }
+#  endif
+    if (pp.pdcount[cls] == CLICK_PACKET_POOL_SIZE) {
+	PacketData *magazine = pp.pd[cls];
+	bool kept = false;
+#  if HAVE_MULTITHREAD
+	kept = depot_put(pp.node, depot_data + cls, magazine);
+#  endif
+	if (!kept && pool_hugepages) {
+	    // slab buffers never go back to the system
+	    magazine->pool_next = pp.spill[cls];
+	    pp.spill[cls] = magazine;
+	    kept = true;
+	}
+	if (!kept) {
+	    delete[] data;
+	    return;
+	}
+	pp.pd[cls] = 0;
+	pp.pdcount[cls] = 0;
+    }
+
+    PacketData *pd = reinterpret_cast<PacketData *>(data);
+    pd->next = pp.pd[cls];
+    pp.pd[cls] = pd;
+    ++pp.pdcount[cls];
+}
+
+#  if CLICK_USERLEVEL
+#   if CLICK_PACKET_POOL_SLABS
+static void
+pool_slab_destructor(unsigned char *data, size_t length)
+{
+    pool_recycle_data(*get_packet_pool(), data, pool_class(length));
+}
+#   endif
+
+// Pooled buffers have this destructor. Heap buffers have none, so that
+// delete[] frees those the pool does not take back.
+static inline Packet::buffer_destructor_type
+pool_buffer_destructor()
+{
+#   if CLICK_PACKET_POOL_SLABS
+    if (pool_hugepages)
+	return pool_slab_destructor;
+#   endif
+    return 0;
+}
+#  endif
+
+static unsigned char *
+pool_allocate_data(PacketPool &pp, int cls)
+{
+    PacketData *pd = pp.pd[cls];
+    uint64_t *counter = &pp.buffer_hits;
+    if (!pd) {
+	if ((pd = pp.spill[cls]))
+	    pp.spill[cls] = pd->pool_next;
+#  if HAVE_MULTITHREAD
+	else if ((pd = static_cast<PacketData *>(depot_take(pp, depot_data + cls))))
+	    /* refilled */;
+#  endif
+#  if CLICK_PACKET_POOL_SLABS
+	else if (pool_hugepages && (pd = pool_allocate_slab(pp, cls)))
+	    counter = &pp.buffer_misses;
+#  endif
+	else
+	    return 0;
+	pp.pdcount[cls] = CLICK_PACKET_POOL_SIZE;
+    }
+    pp.pd[cls] = pd->next;
+    --pp.pdcount[cls];
+    ++*counter;
+    return reinterpret_cast<unsigned char *>(pd);
+}
+
+WritablePacket *
+WritablePacket::pool_allocate()
+{
+    PacketPool &pp = *get_packet_pool();
+    WritablePacket *p = pp.p;
+#  if HAVE_MULTITHREAD
+    if (!p && (p = static_cast<WritablePacket *>(depot_take(pp, depot_packets))))
+	pp.pcount = CLICK_PACKET_POOL_SIZE;
+#  endif
     if (p) {
-	packet_pool.p = static_cast<WritablePacket *>(p->next());
-	--packet_pool.pcount;
-    } else
-	p = new WritablePacket;
+	pp.p = static_cast<WritablePacket *>(p->next());
+	--pp.pcount;
+	++pp.hits;
+    } else if ((p = new WritablePacket))
+	++pp.misses;
     return p;
 }
 
@@ -318,21 +596,21 @@ WritablePacket::pool_allocate(uint32_t headroom, uint32_t length,
 			      uint32_t tailroom)
 {
     uint32_t n = headroom + length + tailroom;
-    if (n < CLICK_PACKET_POOL_BUFSIZ)
-	n = CLICK_PACKET_POOL_BUFSIZ;
-    WritablePacket *p = pool_allocate(n == CLICK_PACKET_POOL_BUFSIZ);
+    int cls = -1;
+    if (n <= pool_bufsiz[pool_normal])
+	n = pool_bufsiz[cls = pool_normal];
+    else if (n <= pool_bufsiz[pool_jumbo])
+	n = pool_bufsiz[cls = pool_jumbo];
+    WritablePacket *p = pool_allocate();
     if (p) {
 	p->initialize();
-	PacketData *pd;
-#  if HAVE_MULTITHREAD
-	PacketPool &packet_pool = *thread_packet_pool;
+	PacketPool &pp = *get_packet_pool();
+	if (cls >= 0 && (p->_head = pool_allocate_data(pp, cls))) {
+#  if CLICK_USERLEVEL
+	    p->_destructor = pool_buffer_destructor();
 #  endif
-	if (n == CLICK_PACKET_POOL_BUFSIZ && (pd = packet_pool.pd)) {
-	    packet_pool.pd = pd->next;
-	    --packet_pool.pdcount;
-	    p->_head = reinterpret_cast<unsigned char *>(pd);
 	} else if ((p->_head = new unsigned char[n]))
-	    /* OK */;
+	    ++pp.buffer_misses;
 	else {
 	    delete p;
 	    return 0;
@@ -348,78 +626,119 @@ void
 WritablePacket::recycle(WritablePacket *p)
 {
     unsigned char *data = 0;
-    if (!p->_data_packet && p->_head && !p->_destructor
-	&& p->_end - p->_head == CLICK_PACKET_POOL_BUFSIZ) {
+    int cls = -1;
+    if (!p->_data_packet && p->_head
+#  if CLICK_USERLEVEL
+	&& p->_destructor == pool_buffer_destructor()
+#  endif
+	&& (cls = pool_class(p->_end - p->_head)) >= 0) {
 	data = p->_head;
 	p->_head = 0;
     }
 
-#  if HAVE_MULTITHREAD
-    PacketPool &packet_pool = *get_packet_pool();
-    if ((packet_pool.p && packet_pool.pcount == CLICK_PACKET_POOL_SIZE)
-	|| (data && packet_pool.pd && packet_pool.pdcount == CLICK_PACKET_POOL_SIZE)) {
-	while (atomic_uint32_t::swap(global_packet_pool_lock, 1) == 1)
-	    /* do nothing */;
+    // Destroy first: killing p's data packet recycles it through here,
+    // and may hand the magazine to the depot.
+    p->~WritablePacket();
 
-	if (packet_pool.p && packet_pool.pcount == CLICK_PACKET_POOL_SIZE) {
-	    if (global_packet_pool.pcount == CLICK_GLOBAL_PACKET_POOL_COUNT) {
-		while (WritablePacket *p = packet_pool.p) {
-		    packet_pool.p = static_cast<WritablePacket *>(p->next());
-		    ::operator delete((void *) p);
-		}
-	    } else {
-		packet_pool.p->set_prev(global_packet_pool.p);
-		global_packet_pool.p = packet_pool.p;
-		++global_packet_pool.pcount;
-		packet_pool.p = 0;
-	    }
-	    packet_pool.pcount = 0;
+    PacketPool &pp = *get_packet_pool();
+    if (pp.pcount == CLICK_PACKET_POOL_SIZE) {
+	bool kept = false;
+#  if HAVE_MULTITHREAD
+	if ((kept = depot_put(pp.node, depot_packets, pp.p))) {
+	    pp.p = 0;
+	    pp.pcount = 0;
 	}
-
-	if (data && packet_pool.pd && packet_pool.pdcount == CLICK_PACKET_POOL_SIZE) {
-	    if (global_packet_pool.pdcount == CLICK_GLOBAL_PACKET_POOL_COUNT) {
-		while (PacketData *pd = packet_pool.pd) {
-		    packet_pool.pd = pd->next;
-		    delete[] reinterpret_cast<unsigned char *>(pd);
-		}
-	    } else {
-		packet_pool.pd->pool_next = global_packet_pool.pd;
-		global_packet_pool.pd = packet_pool.pd;
-		++global_packet_pool.pdcount;
-		packet_pool.pd = 0;
-	    }
-	    packet_pool.pdcount = 0;
+#  endif
+	if (!kept) {
+	    ::operator delete((void *) p);
+	    p = 0;
 	}
+    }
 
-	click_compiler_fence();
-	global_packet_pool_lock = 0;
+    if (p) {
+	p->set_next(pp.p);
+	pp.p = p;
+	++pp.pcount;
+	assert(pp.pcount <= CLICK_PACKET_POOL_SIZE);
     }
+    if (data)
+	pool_recycle_data(pp, data, cls);
+}
+
+/** @brief Configure the packet pool.
+ * @param buffer_length length of pooled buffers, or 0 for the default 2048
+ * @param jumbo_length length of pooled jumbo buffers, or 0 for none
+ * @param hugepages if true, carve pooled buffers out of huge pages
+ * @return 0 on success, -EINVAL on bad lengths, -EOPNOTSUPP if huge pages
+ * are not supported, or -EBUSY if packets were already allocated
+ *
+ * Packet::make() gives a packet whose headroom, length and tailroom fit in
+ * @a buffer_length a pooled buffer of that length, else a pooled jumbo
+ * buffer if it fits in one, else a buffer of its own. Call this before
+ * creating any packets, e.g. from the driver's command line. */
+int
+Packet::configure_pool(uint32_t buffer_length, uint32_t jumbo_length,
+		       bool hugepages)
+{
+    if (!buffer_length)
+	buffer_length = CLICK_PACKET_POOL_BUFSIZ;
+    if (buffer_length < min_buffer_length
+	|| (jumbo_length && jumbo_length <= buffer_length))
+	return -EINVAL;
+#  if !CLICK_PACKET_POOL_SLABS
+    if (hugepages)
+	return -EOPNOTSUPP;
 #  else
-    if (packet_pool.pcount == CLICK_PACKET_POOL_SIZE) {
-	delete p;
-	p = 0;
-    }
-    if (data && packet_pool.pdcount == CLICK_PACKET_POOL_SIZE) {
-	delete[] data;
-	data = 0;
-    }
+    if (hugepages && ((jumbo_length ? jumbo_length : buffer_length) + 63) / 64 * 64
+	> CLICK_PACKET_POOL_SLABSIZ - CLICK_PACKET_POOL_SLABHDR)
+	return -EINVAL;
 #  endif
+#  if HAVE_MULTITHREAD
+    if (all_thread_packet_pools)
+#  else
+    if (packet_pool.hits || packet_pool.misses)
+#  endif
+	return -EBUSY;
+    pool_bufsiz[pool_normal] = buffer_length;
+    pool_bufsiz[pool_jumbo] = jumbo_length;
+    pool_hugepages = hugepages;
+    return 0;
+}
 
-    if (p) {
-	++packet_pool.pcount;	// increment first, lest nested recycle() call (from
-				// _data_packet->kill()) observe incorrect state
-	p->~WritablePacket();
-	p->set_next(packet_pool.p);
-	packet_pool.p = p;
-	assert(packet_pool.pcount <= CLICK_PACKET_POOL_SIZE);
-    }
-    if (data) {
-	++packet_pool.pdcount;
-	PacketData *pd = reinterpret_cast<PacketData *>(data);
-	pd->next = packet_pool.pd;
-	packet_pool.pd = pd;
-	assert(packet_pool.pdcount <= CLICK_PACKET_POOL_SIZE);
-    }
+static void
+unparse_pool_statistics(StringAccum &sa, const PacketPool *pp)
+{
+#  if HAVE_MULTITHREAD
+    sa << "pool " << pp->id << " node " << pp->node << ": ";
+#  endif
+    sa << "hits " << pp->hits << " misses " << pp->misses
+       << " buffer_hits " << pp->buffer_hits << " buffer_misses " << pp->buffer_misses
+       << " refills " << pp->refills << " steals " << pp->steals << '\n';
+}
+
+/** @brief Report packet pool statistics.
+ *
+ * Writes a line per thread pool, in the order the threads first allocated
+ * packets, with the thread's NUMA node; packet header allocations the
+ * pool served (hits) and those that went to the system (misses); the
+ * same for data buffers (buffer_hits, buffer_misses), where a buffer of
+ * no pooled length is a miss; and full magazines taken from the node's
+ * depot (refills) or from another node's (steals).
+ * The counts are updated without locking and may be slightly stale. */
+void
+Packet::pool_statistics(StringAccum &sa)
+{
+#  if HAVE_MULTITHREAD
+    Vector<const PacketPool *> pools(npacket_pools, 0);
+    for (const PacketPool *pp = all_thread_packet_pools; pp; pp = pp->chain)
+	if (pp->id < pools.size())
+	    pools[pp->id] = pp;
+    for (int i = 0; i < pools.size(); ++i)
+	if (pools[i])
+	    unparse_pool_statistics(sa, pools[i]);
+#  else
+    unparse_pool_statistics(sa, &packet_pool);
+#  endif
 }
 
 #endif
@@ -555,7 +874,7 @@ Packet::make(unsigned char *data, uint32_t length,
 	     void (*destructor)(unsigned char *, size_t))
 {
 # if HAVE_CLICK_PACKET_POOL
-    WritablePacket *p = WritablePacket::pool_allocate(false);
+    WritablePacket *p = WritablePacket::pool_allocate();
 # else
     WritablePacket *p = new WritablePacket;
 # endif
@@ -608,7 +927,7 @@ Packet::clone()
 
     // timing: .31-.39 normal, .43-.55 two allocs, .55-.58 two memcpys
 # if HAVE_CLICK_PACKET_POOL
-    Packet *p = WritablePacket::pool_allocate(false);
+    Packet *p = WritablePacket::pool_allocate();
 # else
     Packet *p = new WritablePacket; // no initialization
 # endif
@@ -907,22 +1226,52 @@ Packet::shift_data(int offset, bool free_on_failure)
 
 
 #if HAVE_CLICK_PACKET_POOL
-static void
-cleanup_pool(PacketPool *pp)
+static unsigned
+free_packet_magazine(WritablePacket *p)
 {
-    unsigned pcount = 0, pdcount = 0;
-    while (WritablePacket *p = pp->p) {
-	++pcount;
-	pp->p = static_cast<WritablePacket *>(p->next());
+    unsigned n = 0;
+    for (; p; ++n) {
+	WritablePacket *next = static_cast<WritablePacket *>(p->next());
 	::operator delete((void *) p);
+	p = next;
     }
-    while (PacketData *pd = pp->pd) {
-	++pdcount;
-	pp->pd = pd->next;
-	delete[] reinterpret_cast<unsigned char *>(pd);
+    return n;
+}
+
+static unsigned
+free_data_magazine(PacketData *pd)
+{
+    unsigned n = 0;
+    for (; pd; ++n) {
+	PacketData *next = pd->next;
+	if (!pool_hugepages)	// else in a slab
+	    delete[] reinterpret_cast<unsigned char *>(pd);
+	pd = next;
+    }
+    return n;
+}
+
+// Returns the number of buffers the pool held.
+static unsigned
+cleanup_pool(PacketPool *pp)
+{
+    unsigned pcount = free_packet_magazine(pp->p), nbuffers = 0;
+    assert(pcount == pp->pcount && pcount <= CLICK_PACKET_POOL_SIZE);
+    for (int cls = 0; cls < pool_nclasses; ++cls) {
+	unsigned pdcount = free_data_magazine(pp->pd[cls]);
+	assert(pdcount == pp->pdcount[cls] && pdcount <= CLICK_PACKET_POOL_SIZE);
+	nbuffers += pdcount;
+	while (PacketData *magazine = pp->spill[cls]) {
+	    pp->spill[cls] = magazine->pool_next;
+	    nbuffers += free_data_magazine(magazine);
+	}
+# if HAVE_MULTITHREAD && CLICK_PACKET_POOL_SLABS
+	for (int n = 0; n < CLICK_PACKET_POOL_NODES; ++n)
+	    nbuffers += free_data_magazine(pp->remote[n][cls]);
+# endif
     }
-    assert(pcount == pp->pcount && pdcount == pp->pdcount
-	   && pp->pcount <= CLICK_PACKET_POOL_SIZE && pp->pdcount <= CLICK_PACKET_POOL_SIZE);
+    (void) pcount;
+    return nbuffers;
 }
 #endif
 
@@ -930,24 +1279,37 @@ void
 Packet::static_cleanup()
 {
 #if HAVE_CLICK_PACKET_POOL
+    unsigned nbuffers = 0;
 # if HAVE_MULTITHREAD
     while (PacketPool *pp = all_thread_packet_pools) {
 	all_thread_packet_pools = pp->chain;
-	cleanup_pool(pp);
+	nbuffers += cleanup_pool(pp);
 	delete pp;
     }
-    while (global_packet_pool.p || global_packet_pool.pd) {
-	WritablePacket *next_p = global_packet_pool.p;
-	next_p = (next_p ? static_cast<WritablePacket *>(next_p->prev()) : 0);
-	PacketData *next_pd = global_packet_pool.pd;
-	next_pd = (next_pd ? next_pd->pool_next : 0);
-	cleanup_pool(&global_packet_pool);
-	global_packet_pool.p = next_p;
-	global_packet_pool.pd = next_pd;
-    }
+    npacket_pools = 0;
+    for (int n = 0; n < CLICK_PACKET_POOL_NODES; ++n)
+	for (int i = 0; i < CLICK_GLOBAL_PACKET_POOL_COUNT; ++i) {
+	    free_packet_magazine(static_cast<WritablePacket *>(packet_depot[n][depot_packets][i]));
+	    for (int cls = 0; cls < pool_nclasses; ++cls)
+		nbuffers += free_data_magazine(static_cast<PacketData *>(packet_depot[n][depot_data + cls][i]));
+	    for (int kind = 0; kind < 1 + pool_nclasses; ++kind)
+		packet_depot[n][kind][i] = 0;
+	}
 # else
-    cleanup_pool(&packet_pool);
+    nbuffers += cleanup_pool(&packet_pool);
+# endif
+# if CLICK_PACKET_POOL_SLABS
+    // Packets still alive may point into the slabs; leave them mapped
+    // unless every slab buffer came back.
+    if (nbuffers == pool_slab_buffers)
+	while (PacketSlab *slab = pool_slabs) {
+	    pool_slabs = slab->next;
+	    munmap(slab, slab->size);
+	}
+    pool_slabs = 0;
+    pool_slab_buffers = 0;
 # endif
+    (void) nbuffers;
 #endif
 }
 
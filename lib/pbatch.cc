@@ -1,31 +1,60 @@
 #include <click/config.h>
 #include <click/glue.hh>
 #include <click/pbatch.hh>
+#include <click/sync.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <click/error.hh>
 #include <g4c.h>
+#if CLICK_USERLEVEL
+# include <stdio.h>
+# include <errno.h>
+#endif
 
 CLICK_DECLS
 
+#if CLICK_DEBUG_PBATCH
+atomic_uint32_t PBatch::nlive;
+#endif
+
 PBatch::PBatch(): capacity(CLICK_PBATCH_CAPACITY), npkts(0), pptrs(0), memsize(0),
 		  hostmem(0), devmem(0), hpktlens(0), hslices(0), hpktannos(0),
 		  dpktlens(0), dslices(0), dpktannos(0), slice_begin(0),
 		  slice_end(0), slice_length(0), slice_size(0),
-		  anno_flags(0), anno_size(0), dev_stream(0),
-		  hwork_ptr(0), dwork_ptr(0), work_size(0),
-		  force_pktlens(false), shared(0), nr_users(0), user_priv_len(0),
-		  user_priv(0), hpktflags(0), dpktflags(0)
+		  anno_flags(0), anno_size(0), dev_stream(0), stream_owner(0),
+		  hwork_ptr(0), dwork_ptr(0), work_size(0), h2d_bytes(0), d2h_bytes(0),
+		  force_pktlens(false), parent(0), row_begin(0), row_end(-1),
+		  nr_users(0), user_priv_len(0),
+		  user_priv(0), hpktflags(0), dpktflags(0), pool(0), pool_next(0),
+		  field_flags(0), fields_offset(0),
+		  zero_copy(false), region(0), hpktoffs(0), dpktoffs(0)
 {
+	refs = 0;
+	memset(&hfields, 0, sizeof(hfields));
+	memset(&dfields, 0, sizeof(dfields));
+	trace = 0;
+	memset(tstamps, 0, sizeof(tstamps));
 }
 
 PBatch::PBatch(int _capacity, int _slice_begin, int _slice_end, bool _force_pktlens,
-	       int _anno_flags, int _anno_length):
+	       int _anno_flags, int _anno_length, bool _zero_copy,
+	       int _field_flags):
 	capacity(_capacity), npkts(0), pptrs(0),
 	hostmem(0), devmem(0), hpktlens(0), hslices(0), hpktannos(0),
 	dpktlens(0), dslices(0), dpktannos(0),
-	anno_flags(_anno_flags), dev_stream(0),
-	hwork_ptr(0), dwork_ptr(0), work_size(0), force_pktlens(_force_pktlens),
-	shared(0), nr_users(0), user_priv_len(0), user_priv(0),
-	hpktflags(0), dpktflags(0)
+	anno_flags(_anno_flags), dev_stream(0), stream_owner(0),
+	hwork_ptr(0), dwork_ptr(0), work_size(0), h2d_bytes(0), d2h_bytes(0), force_pktlens(_force_pktlens),
+	parent(0), row_begin(0), row_end(-1),
+	nr_users(0), user_priv_len(0), user_priv(0),
+	hpktflags(0), dpktflags(0), pool(0), pool_next(0),
+	field_flags(_field_flags), fields_offset(0),
+	zero_copy(_zero_copy), region(0), hpktoffs(0), dpktoffs(0)
 {
+	refs = 0;
+	memset(&hfields, 0, sizeof(hfields));
+	memset(&dfields, 0, sizeof(dfields));
+	trace = 0;
+	memset(tstamps, 0, sizeof(tstamps));
 	slice_begin = _slice_begin;
 	slice_end = _slice_end;
 	anno_size = _anno_length;
@@ -38,7 +67,11 @@ PBatch::~PBatch() {}
 void
 PBatch::calculate_parameters()
 {
-	if (slice_end <= 0) {
+	if (slice_end == 0 && field_flags) {
+		// Fields only, no slices.
+		slice_length = 0;
+		slice_size = 0;
+	} else if (slice_end <= 0) {
 		slice_length = CLICK_PBATCH_PACKET_BUFFER_SIZE;
 		slice_size = slice_length;
 	} else {
@@ -52,14 +85,117 @@ PBatch::calculate_parameters()
 		anno_size = g4c_round_up(anno_size, G4C_MEM_ALIGN);
 
 	memsize = 0;
-	if (slice_end < 0||force_pktlens)
+	if (slice_end < 0||force_pktlens||zero_copy)
 		memsize += g4c_round_up(sizeof(short)*capacity, G4C_PAGE_SIZE);
 
 	memsize += g4c_round_up(sizeof(unsigned int)*capacity, G4C_PAGE_SIZE);
-	memsize += g4c_round_up(slice_size*capacity, G4C_PAGE_SIZE);
+	if (zero_copy)
+		memsize += g4c_round_up(sizeof(unsigned int)*capacity, G4C_PAGE_SIZE);
+	else
+		memsize += g4c_round_up(slice_size*capacity, G4C_PAGE_SIZE);
 
         if (anno_flags != 0)
 		memsize += g4c_round_up(anno_size*capacity, G4C_PAGE_SIZE);
+
+	fields_offset = memsize;
+	if (field_flags) {
+		PBatchFields f;
+		memsize += g4c_round_up(set_field_pointers(&f, 0, capacity),
+					G4C_PAGE_SIZE);
+	}
+}
+
+template <typename T> static inline void
+field_column(T *&col, bool want, unsigned char *base, int capacity, int n,
+	     unsigned long &off, unsigned long &end)
+{
+	if (!want) {
+		col = 0;
+		return;
+	}
+	col = (T*)g4c_ptr_add(base, off);
+	end = off + sizeof(T)*n;
+	off += g4c_round_up(sizeof(T)*capacity, G4C_MEM_ALIGN);
+}
+
+/**
+ * Lay out the columns of field_flags from base. Returns the offset from
+ * base at which the first n entries of the last column end, which is the
+ * size of the columns for n == capacity.
+ */
+unsigned long
+PBatch::set_field_pointers(PBatchFields *f, unsigned char *base, int n)
+{
+	unsigned long off = 0, end = 0;
+
+	field_column(f->dst_ips, field_flags & PBATCH_FIELD_DST_IP,
+		     base, capacity, n, off, end);
+	field_column(f->src_ips, field_flags & PBATCH_FIELD_SRC_IP,
+		     base, capacity, n, off, end);
+	field_column(f->protos, field_flags & PBATCH_FIELD_PROTO,
+		     base, capacity, n, off, end);
+	field_column(f->sports, field_flags & PBATCH_FIELD_PORTS,
+		     base, capacity, n, off, end);
+	field_column(f->dports, field_flags & PBATCH_FIELD_PORTS,
+		     base, capacity, n, off, end);
+	field_column(f->ihls, field_flags & PBATCH_FIELD_IHL,
+		     base, capacity, n, off, end);
+	field_column(f->l4offs, field_flags & PBATCH_FIELD_L4_OFF,
+		     base, capacity, n, off, end);
+	return end;
+}
+
+/**
+ * Fill the field columns of packet idx from its Ethernet frame, mac and
+ * len bytes of it. See PBatchFields.
+ */
+void
+PBatch::parse_fields(int idx, const unsigned char *mac, int len)
+{
+	uint32_t dst = 0, src = 0;
+	uint16_t sport = 0, dport = 0, l4off = 0;
+	uint8_t proto = 0, ihl = 0;
+	int l3 = sizeof(click_ether);
+	uint16_t type = 0;
+
+	if (len >= l3) {
+		type = ((const click_ether*)mac)->ether_type;
+		if (type == htons(ETHERTYPE_8021Q) && len >= l3 + 4) {
+			type = ((const click_ether_vlan*)mac)->ether_vlan_encap_proto;
+			l3 += 4;
+		}
+	}
+
+	const click_ip *iph = (const click_ip*)(mac + l3);
+	if (type == htons(ETHERTYPE_IP) && len >= l3 + (int)sizeof(click_ip)
+	    && iph->ip_v == 4 && iph->ip_hl >= 5) {
+		ihl = iph->ip_hl << 2;
+		proto = iph->ip_p;
+		src = ntohl(iph->ip_src.s_addr);
+		dst = ntohl(iph->ip_dst.s_addr);
+		l4off = l3 + ihl;
+		if ((proto == IP_PROTO_TCP || proto == IP_PROTO_UDP)
+		    && !(iph->ip_off & htons(IP_OFFMASK)) && len >= l4off + 4) {
+			const unsigned char *l4 = mac + l4off;
+			sport = (l4[0] << 8) | l4[1];
+			dport = (l4[2] << 8) | l4[3];
+		}
+	}
+
+	if (hfields.dst_ips)
+		hfields.dst_ips[idx] = dst;
+	if (hfields.src_ips)
+		hfields.src_ips[idx] = src;
+	if (hfields.protos)
+		hfields.protos[idx] = proto;
+	if (hfields.sports) {
+		hfields.sports[idx] = sport;
+		hfields.dports[idx] = dport;
+	}
+	if (hfields.ihls)
+		hfields.ihls[idx] = ihl;
+	if (hfields.l4offs)
+		hfields.l4offs[idx] = l4off;
 }
 
 /**
@@ -69,7 +205,19 @@ PBatch::calculate_parameters()
 void
 PBatch::set_pointers()
 {
-	if (slice_end > 0 && !force_pktlens) {
+	if (field_flags) {
+		set_field_pointers(&hfields, (unsigned char*)hostmem + fields_offset,
+				   capacity);
+		set_field_pointers(&dfields, (unsigned char*)devmem + fields_offset,
+				   capacity);
+	}
+
+	if (zero_copy) {
+		set_zero_copy_pointers();
+		return;
+	}
+
+	if (slice_end >= 0 && !force_pktlens) {
 		hpktlens = 0;
 		dpktlens = 0;
 
@@ -105,6 +253,30 @@ PBatch::set_pointers()
 	}
 }
 
+void
+PBatch::set_zero_copy_pointers()
+{
+	unsigned long n = g4c_round_up(sizeof(unsigned int)*capacity, G4C_PAGE_SIZE);
+
+	hslices = 0;
+	dslices = 0;
+	hpktflags = (unsigned int*)hostmem;
+	dpktflags = (unsigned int*)devmem;
+	hpktoffs = (unsigned int*)g4c_ptr_add(hpktflags, n);
+	dpktoffs = (unsigned int*)g4c_ptr_add(dpktflags, n);
+	hpktlens = (short*)g4c_ptr_add(hpktoffs, n);
+	dpktlens = (short*)g4c_ptr_add(dpktoffs, n);
+
+	if (anno_flags == 0) {
+		hpktannos = 0;
+		dpktannos = 0;
+	} else {
+		n = g4c_round_up(sizeof(short)*capacity, G4C_PAGE_SIZE);
+		hpktannos = (unsigned char*)g4c_ptr_add(hpktlens, n);
+		dpktannos = (unsigned char*)g4c_ptr_add(dpktlens, n);
+	}
+}
+
 int
 PBatch::init_for_host_batching()
 {
@@ -125,4 +297,412 @@ PBatch::clean_for_host_batching()
 	delete[] pptrs;
 }
 
+static inline void
+work_range(unsigned long *offs, unsigned long *lens, int &n, void *work,
+	   void *col, unsigned long elem, int begin, int end)
+{
+	if (col) {
+		offs[n] = g4c_ptr_offset(col, work) + elem*begin;
+		lens[n++] = elem*(end - begin);
+	}
+}
+
+/**
+ * Split the work area into the parts in use for npkts packets, so that
+ * a partial batch copies only the first npkts entries of each array
+ * rather than the whole page-rounded layout, and the field columns up to
+ * the npkts entries of the last one. Writes up to max_work_ranges
+ * ranges, as offsets from hwork_ptr and dwork_ptr, and returns their
+ * number. A full batch, or a work area that an element moved away from
+ * the Batcher's default, is copied as one range.
+ *
+ * A part of a split batch copies its own rows of each array and field
+ * column only, see row_begin.
+ */
+int
+PBatch::work_ranges(unsigned long *offs, unsigned long *lens)
+{
+	void *def = zero_copy ? (void*)hpktoffs : (void*)hslices;
+	int n = 0;
+
+	if (hwork_ptr == def && (row_begin > 0 || row_end >= 0)) {
+		int b = row_begin, e = rows_end();
+		if (zero_copy) {
+			work_range(offs, lens, n, hwork_ptr, hpktoffs, sizeof(unsigned int), b, e);
+			work_range(offs, lens, n, hwork_ptr, hpktlens, sizeof(short), b, e);
+		} else if (slice_size)
+			work_range(offs, lens, n, hwork_ptr, hslices, slice_size, b, e);
+		if (hpktannos)
+			work_range(offs, lens, n, hwork_ptr, hpktannos, anno_size, b, e);
+		work_range(offs, lens, n, hwork_ptr, hfields.dst_ips, sizeof(uint32_t), b, e);
+		work_range(offs, lens, n, hwork_ptr, hfields.src_ips, sizeof(uint32_t), b, e);
+		work_range(offs, lens, n, hwork_ptr, hfields.protos, sizeof(uint8_t), b, e);
+		work_range(offs, lens, n, hwork_ptr, hfields.sports, sizeof(uint16_t), b, e);
+		work_range(offs, lens, n, hwork_ptr, hfields.dports, sizeof(uint16_t), b, e);
+		work_range(offs, lens, n, hwork_ptr, hfields.ihls, sizeof(uint8_t), b, e);
+		work_range(offs, lens, n, hwork_ptr, hfields.l4offs, sizeof(uint16_t), b, e);
+		return n;
+	}
+
+	if (npkts >= capacity || hwork_ptr != def) {
+		offs[0] = 0;
+		lens[0] = work_size;
+		return 1;
+	}
+
+	if (zero_copy) {
+		offs[n] = 0;
+		lens[n++] = sizeof(unsigned int)*npkts;
+		offs[n] = g4c_ptr_offset(hpktlens, hwork_ptr);
+		lens[n++] = sizeof(short)*npkts;
+	} else if (slice_size) {
+		offs[n] = 0;
+		lens[n++] = slice_size*npkts;
+	}
+	if (hpktannos) {
+		offs[n] = g4c_ptr_offset(hpktannos, hwork_ptr);
+		lens[n++] = anno_size*npkts;
+	}
+	if (field_flags) {
+		PBatchFields f;
+		offs[n] = fields_offset - g4c_ptr_offset(hwork_ptr, hostmem);
+		lens[n++] = set_field_pointers(&f, 0, npkts);
+	}
+	return n;
+}
+
+/**
+ * Make an empty batch that shares this batch's host and device memory,
+ * user_priv and slot layout, but has its own pptrs and no stream. Move
+ * packets into it by slot index. The sub-batch holds a reference on this
+ * batch, which Batcher::kill_batch drops when the sub-batch dies.
+ */
+PBatch *
+PBatch::new_sub_batch()
+{
+	PBatch *sub = new PBatch(*this);
+	if (!sub)
+		return 0;
+	sub->pptrs = 0;
+	if (sub->init_for_host_batching() < 0) {
+		delete sub;
+		return 0;
+	}
+	sub->dev_stream = 0;
+	sub->stream_owner = 0;
+	sub->h2d_bytes = 0;
+	sub->d2h_bytes = 0;
+	sub->init_refs();
+	sub->parent = this;
+	sub->pool = 0;
+	sub->pool_next = 0;
+	sub->trace = 0;
+	acquire();
+	return sub;
+}
+
+/*
+ * Move row i of an array of elem-sized entries to row to[i], for the n
+ * rows from col, through tmp.
+ */
+static void
+permute_rows(void *col, unsigned long elem, int begin, const int *to, int n,
+	     unsigned char *tmp)
+{
+	if (!col)
+		return;
+	unsigned char *c = (unsigned char*)col + elem*begin;
+	for (int i = 0; i < n; i++)
+		memcpy(tmp + elem*to[i], c + elem*i, elem);
+	memcpy(c, tmp, elem*n);
+}
+
+/**
+ * Partition the batch by packet output port, see PBATCH_PKT_PORT_MASK.
+ * On return outs[port] holds the packets for port, or is 0 when there are
+ * none. This batch keeps the packets of the first port seen, the other
+ * ports get sub-batches, which share its memory. A batch with no packets
+ * left goes to outs[0]. Packets for ports not below nports, and packets
+ * marked PBATCH_PKT_BAD, are killed.
+ *
+ * When there is more than one port, the batch's rows of the host arrays
+ * are first sorted by port, dropped rows last, so that each part owns
+ * one run of rows (row_begin) and the parts' copies to and from the
+ * device never overlap. That moves the slices of the packets on the host.
+ *
+ * Returns the number of packets killed.
+ */
+int
+PBatch::split(PBatch **outs, int nports)
+{
+	int first = -1, drops = 0;
+	bool mixed = false;
+	int w0 = row_begin, w1 = rows_end();
+
+	for (int port = 0; port < nports; port++)
+		outs[port] = 0;
+
+	for (int i = w0; i < w1; i++) {
+		if (dropped(i))
+			continue;
+		int port = pkt_port(i);
+		if (port >= nports || pkt_bad(i)) {
+			pptrs[i]->kill();
+			set_dropped(i);
+			drops++;
+		} else if (first < 0)
+			first = port;
+		else if (port != first)
+			mixed = true;
+	}
+
+	if (first < 0) {
+		outs[0] = this;
+		return drops;
+	}
+	outs[first] = this;
+	if (!mixed)
+		return drops;
+
+	// Rows per port, dropped ones as port nports, then where each
+	// port's run starts in the window.
+	int n = w1 - w0;
+	int *start = new int[nports + 2];
+	int *to = new int[n];
+	memset(start, 0, sizeof(int)*(nports + 2));
+	for (int i = 0; i < n; i++)
+		start[(dropped(w0 + i) ? nports : pkt_port(w0 + i)) + 1]++;
+	for (int port = 0; port <= nports; port++)
+		start[port + 1] += start[port];
+	for (int i = 0; i < n; i++)
+		to[i] = start[dropped(w0 + i) ? nports : pkt_port(w0 + i)]++;
+	for (int port = nports + 1; port > 0; port--)
+		start[port] = start[port - 1];
+	start[0] = 0;
+
+	unsigned long elem = zero_copy ? sizeof(unsigned int) : slice_size;
+	if (anno_size > (int)elem)
+		elem = anno_size;
+	if (elem < sizeof(Packet*))
+		elem = sizeof(Packet*);
+	unsigned char *tmp = new unsigned char[elem*n];
+
+	permute_rows(pptrs, sizeof(Packet*), w0, to, n, tmp);
+	permute_rows(hpktflags, sizeof(unsigned int), w0, to, n, tmp);
+	permute_rows(hpktlens, sizeof(short), w0, to, n, tmp);
+	if (zero_copy)
+		permute_rows(hpktoffs, sizeof(unsigned int), w0, to, n, tmp);
+	else if (slice_size)
+		permute_rows(hslices, slice_size, w0, to, n, tmp);
+	permute_rows(hpktannos, anno_size, w0, to, n, tmp);
+	permute_rows(hfields.dst_ips, sizeof(uint32_t), w0, to, n, tmp);
+	permute_rows(hfields.src_ips, sizeof(uint32_t), w0, to, n, tmp);
+	permute_rows(hfields.protos, sizeof(uint8_t), w0, to, n, tmp);
+	permute_rows(hfields.sports, sizeof(uint16_t), w0, to, n, tmp);
+	permute_rows(hfields.dports, sizeof(uint16_t), w0, to, n, tmp);
+	permute_rows(hfields.ihls, sizeof(uint8_t), w0, to, n, tmp);
+	permute_rows(hfields.l4offs, sizeof(uint16_t), w0, to, n, tmp);
+	delete[] tmp;
+	delete[] to;
+
+	// Hand each other port's run to a sub-batch.
+	for (int port = 0; port < nports; port++) {
+		int b = w0 + start[port], e = w0 + start[port + 1];
+		if (b == e || port == first)
+			continue;
+		if (!(outs[port] = new_sub_batch())) {
+			for (int i = b; i < e; i++) {
+				pptrs[i]->kill();
+				set_dropped(i);
+				drops++;
+			}
+			continue;
+		}
+		for (int i = b; i < e; i++) {
+			outs[port]->pptrs[i] = pptrs[i];
+			pptrs[i] = 0;
+		}
+		outs[port]->row_begin = b;
+		outs[port]->row_end = e;
+	}
+	row_begin = w0 + start[first];
+	row_end = w0 + start[first + 1];
+	delete[] start;
+	return drops;
+}
+
+
+const char * const PBatchTrace::stage_names[PBATCH_NR_TS] = {
+	"first", "fill", "h2d", "kernel", "d2h", "completion", "debatch"
+};
+
+PBatchTrace::PBatchTrace() : _ring(0), _ring_size(0), _recorded(0)
+{
+	_refcount = 1;
+}
+
+PBatchTrace::~PBatchTrace()
+{
+	delete[] _ring;
+}
+
+/**
+ * Keep the stamps of the last n batches, 0 for none. Drops what the ring
+ * held.
+ */
+int
+PBatchTrace::set_ring_size(uint32_t n)
+{
+	delete[] _ring;
+	_ring = 0;
+	_ring_size = 0;
+	_recorded = 0;
+	if (n && !(_ring = new record[n]))
+		return -ENOMEM;
+	_ring_size = n;
+	return 0;
+}
+
+void
+PBatchTrace::record_batch(PBatch *pb)
+{
+	int prev = -1;
+
+	for (int i = 0; i < PBATCH_NR_TS; i++)
+		if (pb->tstamps[i]) {
+			if (prev >= 0)
+				_stages[i].add(pb->tstamps[i] - pb->tstamps[prev]);
+			prev = i;
+		}
+	if (prev > 0 && pb->tstamps[0])
+		_total.add(pb->tstamps[prev] - pb->tstamps[0]);
+
+	if (_ring_size) {
+		record &r = _ring[_recorded % _ring_size];
+		for (int i = 0; i < PBATCH_NR_TS; i++)
+			r.tstamps[i] = pb->tstamps[i];
+		r.npkts = pb->npkts;
+		r.capacity = pb->capacity;
+		_recorded++;
+	}
+}
+
+void
+PBatchTrace::clear()
+{
+	for (int i = 0; i < PBATCH_NR_TS; i++)
+		_stages[i].clear();
+	_total.clear();
+	_recorded = 0;
+}
+
+/**
+ * One line per stage: its name, count, and p50, p99, p999 and max in
+ * cycles.
+ */
+String
+PBatchTrace::unparse() const
+{
+	StringAccum sa;
+
+	for (int i = 1; i <= PBATCH_NR_TS; i++) {
+		const HVPHistogram &h = i < PBATCH_NR_TS ? _stages[i] : _total;
+		if (!h.count())
+			continue;
+		sa << (i < PBATCH_NR_TS ? stage_names[i] : "total")
+		   << ' ' << h.count()
+		   << " p50 " << h.percentile(50, 100)
+		   << " p99 " << h.percentile(99, 100)
+		   << " p999 " << h.percentile(999, 1000)
+		   << " max " << h.max() << '\n';
+	}
+	return sa.take_string();
+}
+
+int
+PBatchTrace::dump(const String &filename, ErrorHandler *errh) const
+{
+#if CLICK_USERLEVEL
+	struct {
+		char magic[4];
+		uint32_t version;
+		uint32_t nr_ts;
+		uint32_t record_size;
+		uint64_t nrecords;
+	} hdr;
+	uint64_t n = _recorded < _ring_size ? _recorded : _ring_size;
+
+	memcpy(hdr.magic, "HVPT", 4);
+	hdr.version = 1;
+	hdr.nr_ts = PBATCH_NR_TS;
+	hdr.record_size = sizeof(record);
+	hdr.nrecords = n;
+
+	FILE *f = fopen(filename.c_str(), "wb");
+	if (!f)
+		return errh->error("%s: %s", filename.c_str(), strerror(errno));
+
+	bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+	for (uint64_t i = _recorded - n; ok && i < _recorded; i++)
+		ok = fwrite(&_ring[i % _ring_size], sizeof(record), 1, f) == 1;
+	if (fclose(f) != 0)
+		ok = false;
+	if (!ok)
+		return errh->error("%s: %s", filename.c_str(), strerror(errno));
+	return 0;
+#else
+	(void) filename;
+	return errh->error("trace dumps need userlevel");
+#endif
+}
+
+static PBatchRegion pbatch_regions[PBatchRegion::max_regions];
+static int pbatch_nregions;	// entries ever used
+
+/**
+ * Register a region for zero-copy batching. Regions are expected to be
+ * registered at configuration time, before packets flow.
+ */
+int
+PBatchRegion::add(void *hbase, void *dbase, unsigned long size)
+{
+	int i;
+	for (i = 0; i < pbatch_nregions; i++)
+		if (!pbatch_regions[i].size)
+			break;
+	if (i == max_regions)
+		return -1;
+
+	PBatchRegion &r = pbatch_regions[i];
+	r.hbase = (unsigned char*)hbase;
+	r.dbase = (unsigned char*)dbase;
+	r.gen++;
+	click_compiler_fence();
+	r.size = size;
+	if (i == pbatch_nregions)
+		pbatch_nregions++;
+	return 0;
+}
+
+void
+PBatchRegion::remove(void *hbase)
+{
+	for (int i = 0; i < pbatch_nregions; i++)
+		if (pbatch_regions[i].size && pbatch_regions[i].hbase == hbase) {
+			pbatch_regions[i].size = 0;
+			click_compiler_fence();
+			pbatch_regions[i].gen++;
+			return;
+		}
+}
+
+const PBatchRegion *
+PBatchRegion::find(const unsigned char *p)
+{
+	for (int i = 0; i < pbatch_nregions; i++)
+		if (pbatch_regions[i].contains(p))
+			return &pbatch_regions[i];
+	return 0;
+}
+
 CLICK_ENDDECLS
@@ -132,6 +132,9 @@ Router::~Router()
 
     delete _root_element;
 
+    for (int i = 0; i < _cleanup_hooks.size(); i++)
+	_cleanup_hooks[i](this, _cleanup_hook_data[i]);
+
 #if CLICK_LINUXMODULE
     // decrement module use counts
     for (struct module **m = _modules.begin(); m < _modules.end(); m++) {
@@ -1841,6 +1844,19 @@ Router::set_attachment(const String &name, void *value)
     return 0;
 }
 
+/** @brief  Register a function to run when the router is destroyed.
+ *  @param  hook  function to call
+ *  @param  user_data  passed to @a hook
+ *
+ *  Hooks run in registration order after every element has been cleaned
+ *  up and deleted, so they must not refer to elements. */
+void
+Router::add_cleanup_hook(CleanupHook hook, void *user_data)
+{
+    _cleanup_hooks.push_back(hook);
+    _cleanup_hook_data.push_back(user_data);
+}
+
 ErrorHandler *
 Router::chatter_channel(const String &name) const
 {
@@ -1909,6 +1925,12 @@ ThreadSched::initial_home_thread_id(const Element *)
     return 0;
 }
 
+bool
+ThreadSched::initial_migratable(const Element *)
+{
+    return false;
+}
+
 /** @cond never */
 /** @brief  Create (if necessary) and return the NameInfo object for this router.
  *
@@ -2151,7 +2173,9 @@ Router::configuration_string() const
 enum { GH_VERSION, GH_CONFIG, GH_FLATCONFIG, GH_LIST, GH_REQUIREMENTS,
        GH_DRIVER, GH_ACTIVE_PORTS, GH_ACTIVE_PORT_STATS, GH_STRING_PROFILE,
        GH_STRING_PROFILE_LONG, GH_SCHEDULING_PROFILE, GH_STOP,
-       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES };
+       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES, GH_PACKET_POOL,
+       GH_TIMER_GRANULARITY, GH_WORK_STEALING, GH_WORK_STEALING_STATS,
+       GH_IDLE_POLICY, GH_IDLE_STATS };
 
 #if CLICK_STATS >= 2
 struct stats_info {
@@ -2252,6 +2276,63 @@ Router::router_read_handler(Element *e, void *thunk)
 	break;
 #endif
 
+#if HAVE_CLICK_PACKET_POOL
+    case GH_PACKET_POOL:
+	Packet::pool_statistics(sa);
+	break;
+#endif
+
+    case GH_TIMER_GRANULARITY:
+	if (r)
+	    return r->master()->thread(0)->timer_set().wheel_granularity().unparse_interval();
+	break;
+
+#if HAVE_MULTITHREAD
+    case GH_WORK_STEALING:
+	if (r)
+	    return String(r->master()->work_stealing());
+	break;
+
+    case GH_WORK_STEALING_STATS:
+	if (r)
+	    for (int tid = 0; tid < r->master()->nthreads(); ++tid) {
+		RouterThread *t = r->master()->thread(tid);
+		sa << "thread " << tid << ": steals " << t->steals()
+		   << " attempts " << t->steal_attempts()
+		   << " stolen " << t->stolen()
+		   << " offers " << t->steal_offers() << '\n';
+	    }
+	break;
+#endif
+
+#if CLICK_USERLEVEL
+    case GH_IDLE_POLICY:
+	if (r)
+	    for (int tid = 0; tid < r->master()->nthreads(); ++tid) {
+		RouterThread *t = r->master()->thread(tid);
+		sa << "thread " << tid << ": SPIN " << t->idle_spin().unparse_interval()
+		   << ", YIELD " << t->idle_yield().unparse_interval()
+		   << ", ADAPTIVE " << t->idle_adaptive();
+		if (t->idle_adaptive())
+		    sa << " (spin " << t->idle_spin_current().unparse_interval() << ')';
+		sa << '\n';
+	    }
+	break;
+
+    case GH_IDLE_STATS:
+	if (r)
+	    for (int tid = 0; tid < r->master()->nthreads(); ++tid) {
+		RouterThread *t = r->master()->thread(tid);
+		static const char * const phases[] = { "spin", "yield", "block" };
+		sa << "thread " << tid << ':';
+		for (int p = 0; p < RouterThread::NIDLE; ++p)
+		    sa << ' ' << phases[p] << ' ' << t->idle_time(p)
+		       << "s wakeups " << t->idle_wakeups(p);
+		sa << '\n';
+	    }
+	break;
+#endif
+
 #if CLICK_STATS >= 2
     case GH_ELEMENT_CYCLES:
 	if (!r)
@@ -2361,6 +2442,58 @@ Router::router_write_handler(const String &s, Element *e, void *thunk, ErrorHand
 	for (int i = 0; i < (r ? r->nelements() : 0); i++)
 	    r->_elements[i]->reset_cycles();
 	break;
+#endif
+    case GH_TIMER_GRANULARITY: {
+	Timestamp g;
+	if (!TimestampArg().parse(s, g) || g <= Timestamp())
+	    return errh->error("expected positive time");
+	for (int tid = -1; tid < r->master()->nthreads(); ++tid)
+	    r->master()->thread(tid)->timer_set().set_wheel_granularity(g);
+	break;
+    }
+#if HAVE_MULTITHREAD
+    case GH_WORK_STEALING: {
+	bool on;
+	if (!BoolArg().parse(s, on))
+	    return errh->error("expected boolean");
+	r->master()->set_work_stealing(on);
+	break;
+    }
+#endif
+#if CLICK_USERLEVEL
+    case GH_IDLE_POLICY: {
+	// "KEYWORD value" pairs, separated by spaces or commas
+	Vector<String> words, conf;
+	cp_spacevec(s, words);
+	for (int i = 0; i < words.size(); i += 2) {
+	    String value = (i + 1 < words.size() ? words[i + 1] : String());
+	    if (value.length() && value.back() == ',')
+		value = value.substring(0, -1);
+	    conf.push_back(words[i] + " " + value);
+	}
+	int thread = -1;
+	Args args(errh);
+	if (args.bind(conf).read("THREAD", thread).consume() < 0)
+	    return -1;
+	Master *m = r->master();
+	if (thread < -1 || thread >= m->nthreads())
+	    return errh->error("no thread %d", thread);
+	RouterThread *t = m->thread(thread < 0 ? 0 : thread);
+	Timestamp spin = t->idle_spin(), yield = t->idle_yield();
+	bool adaptive = t->idle_adaptive();
+	if (Args(conf, errh)
+	    .read("SPIN", spin)
+	    .read("YIELD", yield)
+	    .read("ADAPTIVE", adaptive)
+	    .complete() < 0)
+	    return -1;
+	if (spin.is_negative() || yield.is_negative())
+	    return errh->error("negative idle time");
+	for (int tid = (thread < 0 ? 0 : thread);
+	     tid < (thread < 0 ? m->nthreads() : thread + 1); ++tid)
+	    m->thread(tid)->set_idle_policy(spin, yield, adaptive);
+	break;
+    }
 #endif
     default:
 	break;
@@ -2394,6 +2527,21 @@ Router::static_initialize()
 #if CLICK_DEBUG_MASTER || CLICK_DEBUG_SCHEDULING
 	add_read_handler(0, "scheduling_profile", router_read_handler, (void *) GH_SCHEDULING_PROFILE);
 #endif
+#if HAVE_CLICK_PACKET_POOL
+	add_read_handler(0, "packet_pool", router_read_handler, (void *) GH_PACKET_POOL);
+#endif
+	add_read_handler(0, "timer_granularity", router_read_handler, (void *) GH_TIMER_GRANULARITY);
+	add_write_handler(0, "timer_granularity", router_write_handler, (void *) GH_TIMER_GRANULARITY);
+#if HAVE_MULTITHREAD
+	add_read_handler(0, "work_stealing", router_read_handler, (void *) GH_WORK_STEALING);
+	add_write_handler(0, "work_stealing", router_write_handler, (void *) GH_WORK_STEALING);
+	add_read_handler(0, "work_stealing_stats", router_read_handler, (void *) GH_WORK_STEALING_STATS);
+#endif
+#if CLICK_USERLEVEL
+	add_read_handler(0, "idle_policy", router_read_handler, (void *) GH_IDLE_POLICY);
+	add_write_handler(0, "idle_policy", router_write_handler, (void *) GH_IDLE_POLICY);
+	add_read_handler(0, "idle_stats", router_read_handler, (void *) GH_IDLE_STATS);
+#endif
 #if CLICK_STATS >= 2
         add_read_handler(0, "element_cycles.csv", router_read_handler, (void *)GH_ELEMENT_CYCLES);
         add_read_handler(0, "class_cycles.csv", router_read_handler, (void *)GH_CLASS_CYCLES);
@@ -39,6 +39,7 @@ CLICK_CXX_UNPROTECT
 # include <click/cxxunprotect.h>
 #elif CLICK_USERLEVEL
 # include <fcntl.h>
+# include <sched.h>
 #endif
 CLICK_DECLS
 
@@ -77,6 +78,11 @@ RouterThread::RouterThread(Master *m, int id)
 #elif CLICK_USERLEVEL && HAVE_MULTITHREAD
     _running_processor = click_invalid_processor();
 #endif
+#if HAVE_MULTITHREAD
+    _steal_idle = false;
+    _steals = _steal_attempts = _steal_offers = 0;
+    _stolen = 0;
+#endif
 
     _task_blocker = 0;
     _task_blocker_waiting = 0;
@@ -106,6 +112,14 @@ RouterThread::RouterThread(Master *m, int id)
 #if CLICK_LINUXMODULE
     greedy_schedule_jiffies = jiffies;
 #endif
+#if CLICK_USERLEVEL
+    // by default, block as soon as there are no tasks
+    _idle_adaptive = false;
+    _idle_phase = -1;
+    for (int p = 0; p < NIDLE; ++p)
+	_idle_wakeups[p] = 0;
+    _idle_spin_hits = _idle_spin_near = _idle_spin_misses = 0;
+#endif
 
 #if CLICK_DEBUG_SCHEDULING
     _thread_state = S_BLOCKED;
@@ -311,6 +325,211 @@ RouterThread::task_epoch_time(uint32_t epoch) const
 #endif
 
 
+/******************************/
+/* Idle policy                */
+/******************************/
+
+#if CLICK_USERLEVEL
+
+#define IDLE_ADAPT_PERIODS	32	/* idle periods between adjustments */
+
+/** @brief Set the thread's idle policy.
+ * @param spin time to poll without blocking once out of tasks
+ * @param yield further time to poll and yield the CPU between polls
+ * @param adaptive if true, adjust the spin time between @a spin/64 and
+ * @a spin
+ *
+ * After @a spin plus @a yield the thread blocks until a task, timer, or
+ * file descriptor needs it.  Spinning avoids the wakeup latency of
+ * blocking at the cost of the CPU; with zero times, the default, the
+ * thread blocks at once.  An adaptive policy shortens the spin while most
+ * idle periods outlast it, and lengthens it again, up to @a spin, while
+ * many end soon after it runs out. */
+void
+RouterThread::set_idle_policy(const Timestamp &spin, const Timestamp &yield,
+			      bool adaptive)
+{
+    _idle_spin = _idle_spin_max = spin;
+    _idle_yield = yield;
+    _idle_adaptive = adaptive;
+    _idle_spin_hits = _idle_spin_near = _idle_spin_misses = 0;
+    wake();
+}
+
+/* Called before run_os when out of tasks: enter or advance the idle
+   period. */
+void
+RouterThread::update_idle_phase()
+{
+    Timestamp now = Timestamp::now_steady();
+    if (_idle_phase < 0) {
+	_idle_since = _idle_phase_start = now;
+	_idle_phase = IDLE_SPIN;
+    }
+    Timestamp idle = now - _idle_since;
+    int phase;
+    if (idle < _idle_spin)
+	phase = IDLE_SPIN;
+    else if (idle < _idle_spin + _idle_yield)
+	phase = IDLE_YIELD;
+    else
+	phase = IDLE_BLOCK;
+    if (phase != _idle_phase) {
+	_idle_time[_idle_phase] += now - _idle_phase_start;
+	_idle_phase_start = now;
+	_idle_phase = phase;
+    }
+}
+
+/* Called when tasks show up again: close the idle period, crediting the
+   wakeup to the phase it ended in. */
+void
+RouterThread::end_idle()
+{
+    Timestamp now = Timestamp::now_steady();
+    _idle_time[_idle_phase] += now - _idle_phase_start;
+    ++_idle_wakeups[_idle_phase];
+    _idle_phase = -1;
+
+    if (_idle_adaptive && _idle_spin_max) {
+	Timestamp idle = now - _idle_since;
+	if (idle < _idle_spin)
+	    ++_idle_spin_hits;
+	else if (idle < _idle_spin * 2)
+	    ++_idle_spin_near;
+	else
+	    ++_idle_spin_misses;
+	if (_idle_spin_hits + _idle_spin_near + _idle_spin_misses >= IDLE_ADAPT_PERIODS)
+	    adapt_idle_spin();
+    }
+}
+
+/* Double the spin limit if more idle periods ended just after it than
+   within it; halve it if most outlasted even twice the limit.  The limit
+   never drops below one Timestamp tick, or doubling could not bring it
+   back. */
+void
+RouterThread::adapt_idle_spin()
+{
+    Timestamp min_spin = _idle_spin_max / 64;
+    if (min_spin < Timestamp::epsilon())
+	min_spin = Timestamp::epsilon();
+    if (_idle_spin_near > _idle_spin_hits) {
+	_idle_spin = (_idle_spin ? _idle_spin * 2 : min_spin);
+	if (_idle_spin > _idle_spin_max)
+	    _idle_spin = _idle_spin_max;
+    } else if (_idle_spin_misses > 3 * (_idle_spin_hits + _idle_spin_near)) {
+	_idle_spin = _idle_spin / 2;
+	if (_idle_spin < min_spin)
+	    _idle_spin = min_spin;
+    }
+    _idle_spin_hits = _idle_spin_near = _idle_spin_misses = 0;
+}
+
+#endif
+
+
+/******************************/
+/* Work stealing              */
+/******************************/
+
+#if HAVE_MULTITHREAD
+
+/* Offer the scheduled task 't' to idle threads.  Called from run_tasks
+   while other tasks are waiting behind 't', so this thread is busy. */
+void
+RouterThread::offer_task(Task *t)
+{
+    bool was_empty = _steal_deque.size() == 0;
+    t->_steal_offered = true;
+    if (!_steal_deque.push(t)) {
+	t->_steal_offered = false;
+	return;
+    }
+    ++_steal_offers;
+    if (was_empty)
+	for (int tid = 0; tid < _master->nthreads(); ++tid) {
+	    RouterThread *thread = _master->thread(tid);
+	    if (thread->_steal_idle) {
+		thread->wake();
+		break;
+	    }
+	}
+}
+
+/* Drop this thread's outstanding offers. */
+void
+RouterThread::withdraw_offers()
+{
+    Task *t;
+    while (_steal_deque.pop(t))
+	if (t) {
+	    click_fence();
+	    t->_steal_offered = false;
+	}
+}
+
+/* Return the peer with the most outstanding offers, or null. */
+RouterThread *
+RouterThread::steal_victim() const
+{
+    RouterThread *victim = 0;
+    unsigned most = 0;
+    for (int tid = 0; tid < _master->nthreads(); ++tid) {
+	RouterThread *thread = _master->thread(tid);
+	unsigned n = thread->_steal_deque.size();
+	if (thread != this && n > most) {
+	    victim = thread;
+	    most = n;
+	}
+    }
+    return victim;
+}
+
+/* Take one task offered by the busiest peer.  The task's home thread is
+   switched to this thread only if it is still scheduled, still at home on
+   the victim, and still migratable; the ordinary move_thread protocol then
+   hands it over, so it arrives here through the pending list. */
+bool
+RouterThread::steal_task()
+{
+    RouterThread *victim;
+    Task *t;
+    for (int tries = 0;
+	 tries < TaskStealDeque::capacity && (victim = steal_victim());
+	 ++tries) {
+	++_steal_attempts;
+	if (!victim->_steal_deque.steal(t))
+	    continue;
+	if (!t)
+	    continue;
+
+	Task::Status want_status;
+	want_status.home_thread_id = victim->thread_id();
+	want_status.is_scheduled = true;
+	want_status.is_strong_unscheduled = false;
+	Task::Status new_status(want_status);
+	new_status.home_thread_id = thread_id();
+
+	bool stolen = t->_migratable && t->router()->running()
+	    && atomic_uint32_t::compare_swap(t->_status.status, want_status.status, new_status.status) == want_status.status;
+	if (stolen)
+	    t->move_thread_second_half();
+	click_fence();
+	t->_steal_offered = false;
+
+	if (stolen) {
+	    ++_steals;
+	    ++victim->_stolen;
+	    return true;
+	}
+    }
+    return false;
+}
+
+#endif
+
+
 /******************************/
 /* The driver loop            */
 /******************************/
@@ -353,7 +572,8 @@ RouterThread::task_reheapify_from(int pos, Task* t)
 }
 #endif
 
-/* Run at most 'ntasks' tasks. */
+/* Run at most 'ntasks' tasks, counting a task that charged for several
+   units of work as that many tasks. */
 inline void
 RouterThread::run_tasks(int ntasks)
 {
@@ -390,6 +610,7 @@ RouterThread::run_tasks(int ntasks)
     int runs;
 #endif
     bool work_done;
+    unsigned charge;
 
     for (; ntasks >= 0; --ntasks) {
 	t = task_begin();
@@ -412,6 +633,15 @@ RouterThread::run_tasks(int ntasks)
 	t->_status.is_scheduled = false;
 	work_done = t->fire();
 
+	// A run charged for several units of work uses up that much of
+	// this round's budget.
+	charge = t->_charge;
+	if (charge > Task::MAX_CHARGE)
+	    charge = Task::MAX_CHARGE;
+	else if (charge == 0)
+	    charge = 1;
+	ntasks -= (int) charge - 1;
+
 #if HAVE_MULTITHREAD
 	if (runs > PROFILE_ELEMENT) {
 	    unsigned delta = click_get_cycles() - cycles;
@@ -421,9 +651,22 @@ RouterThread::run_tasks(int ntasks)
 
 	// fix task list
 	if (t->scheduled()) {
-	    // adjust position in scheduled list
+	    // adjust position in scheduled list, in proportion to the work
 #if HAVE_STRIDE_SCHED
-	    t->_pass += t->_stride;
+	    t->_pass += t->_stride * charge;
+#endif
+
+#if HAVE_MULTITHREAD
+	    // Offer a migratable task to idle threads if others are waiting.
+	    if (t->_migratable && !t->_steal_offered
+		&& _master->work_stealing()
+# if HAVE_TASK_HEAP
+		&& _task_heap.size() > 1
+# else
+		&& t->_next != this
+# endif
+		)
+		offer_task(t);
 #endif
 
 	    // If the task didn't do any work, don't run it next.  This might
@@ -495,6 +738,10 @@ RouterThread::run_os()
 
 #if CLICK_USERLEVEL
     select_set().run_selects(this);
+    if (_idle_phase == IDLE_YIELD) {
+	set_thread_state(S_YIELD);
+	sched_yield();
+    }
 #elif CLICK_LINUXMODULE		/* Linux kernel module */
     if (_greedy) {
 	if (time_after(jiffies, greedy_schedule_jiffies + 5 * CLICK_HZ)) {
@@ -615,6 +862,11 @@ RouterThread::driver()
 	if (_pending_head)
 	    process_pending();
 
+#if CLICK_USERLEVEL
+	if (unlikely(_idle_phase >= 0) && active())
+	    end_idle();
+#endif
+
 	// run tasks
 	do {
 #if HAVE_ADAPTIVE_SCHEDULER
@@ -660,8 +912,25 @@ RouterThread::driver()
 		break;
 #elif BSD_NETISRSCHED
 	    break;
+#endif
+#if HAVE_MULTITHREAD
+	    // Out of tasks: look for work on busier threads before sleeping.
+	    if (_master->work_stealing() && !active()) {
+		withdraw_offers();
+		_steal_idle = true;
+		click_fence();
+		if (steal_task())
+		    _steal_idle = false;
+	    }
+#endif
+#if CLICK_USERLEVEL
+	    if (!active())
+		update_idle_phase();
 #endif
 	    run_os();
+#if HAVE_MULTITHREAD
+	    _steal_idle = false;
+#endif
 	} while (0);
 
 #if CLICK_NS || BSD_NETISRSCHED
@@ -774,6 +1043,8 @@ RouterThread::thread_state_name(int ts)
     case S_RUNSIGNAL:		return String::make_stable("runsignal");
     case S_RUNPENDING:		return String::make_stable("runpending");
     case S_RUNSELECT:		return String::make_stable("runselect");
+    case S_SPIN:		return String::make_stable("spin");
+    case S_YIELD:		return String::make_stable("yield");
     default:			return String(ts);
     }
 }
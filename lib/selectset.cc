@@ -33,10 +33,14 @@
 #  define EV_SET_UDATA_CAST	/* nothing */
 # endif
 #endif
+#if HAVE_ALLOW_EPOLL
+# include <sys/epoll.h>
+#endif
 CLICK_DECLS
 
 namespace {
-enum { SELECT_READ = Element::SELECT_READ, SELECT_WRITE = Element::SELECT_WRITE };
+enum { SELECT_READ = Element::SELECT_READ, SELECT_WRITE = Element::SELECT_WRITE,
+       SELECT_EDGE = Element::SELECT_EDGE };
 #if !HAVE_ALLOW_POLL
 enum { POLLIN = Element::SELECT_READ, POLLOUT = Element::SELECT_WRITE };
 #endif
@@ -58,6 +62,14 @@ SelectSet::SelectSet()
 # endif
 #endif
 
+#if HAVE_ALLOW_EPOLL
+    // Each RouterThread has its own SelectSet, and so its own epoll
+    // instance.  Registrations persist in the kernel between waits.
+    _epoll = epoll_create(256);
+    if (_epoll >= 0)
+	fcntl(_epoll, F_SETFD, FD_CLOEXEC);
+#endif
+
 #if !HAVE_ALLOW_POLL
     FD_ZERO(&_read_select_fd_set);
     FD_ZERO(&_write_select_fd_set);
@@ -85,6 +97,10 @@ SelectSet::~SelectSet()
 #if HAVE_ALLOW_KQUEUE
     if (_kqueue >= 0)
 	close(_kqueue);
+#endif
+#if HAVE_ALLOW_EPOLL
+    if (_epoll >= 0)
+	close(_epoll);
 #endif
     if (_wake_pipe[0] >= 0) {
 	close(_wake_pipe[0]);
@@ -125,8 +141,52 @@ SelectSet::kill_router(Router *router)
     unlock();
 }
 
+#if HAVE_ALLOW_EPOLL
+int
+SelectSet::update_epoll(int fd, int old_events)
+{
+    int pi = _selinfo[fd].pollfd;
+    int events = (pi >= 0 ? _pollfds[pi].events : 0);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (events & POLLIN ? (uint32_t) EPOLLIN : 0)
+	| (events & POLLOUT ? (uint32_t) EPOLLOUT : 0)
+	| (_selinfo[fd].edge ? (uint32_t) EPOLLET : 0);
+    ev.data.fd = fd;
+
+    int op = (!old_events ? EPOLL_CTL_ADD : !events ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+    int r = epoll_ctl(_epoll, op, fd, &ev);
+    // The kernel drops a closed fd from the epoll set on its own, so a
+    // reused fd number may need adding again.
+    if (r < 0 && op == EPOLL_CTL_MOD && errno == ENOENT)
+	r = epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev);
+    if (r < 0 && op == EPOLL_CTL_DEL && (errno == EBADF || errno == ENOENT))
+	r = 0;
+    else if (r < 0) {
+	r = -errno;
+	// EPERM means the fd cannot be epolled at all, which is expected
+	// for regular files
+	if (r != -EPERM)
+	    click_chatter("SelectSet: epoll_ctl(fd %d): %s", fd, strerror(-r));
+    }
+    return r;
+}
+
 void
-SelectSet::register_select(int fd, bool add_read, bool add_write)
+SelectSet::remove_noepoll(int fd)
+{
+    for (int i = 0; i < _noepoll_fds.size(); ++i)
+	if (_noepoll_fds[i] == fd) {
+	    _noepoll_fds[i] = _noepoll_fds.back();
+	    _noepoll_fds.pop_back();
+	    break;
+	}
+    _selinfo[fd].noepoll = false;
+}
+#endif
+
+int
+SelectSet::register_select(int fd, bool add_read, bool add_write, bool edge)
 {
     // add the pollfd
     if (fd >= _selinfo.size())
@@ -138,12 +198,44 @@ SelectSet::register_select(int fd, bool add_read, bool add_write)
 	_pollfds.back().events = 0;
     }
     int pi = _selinfo[fd].pollfd;
+#if HAVE_ALLOW_EPOLL
+    int old_events = _pollfds[pi].events;
+    bool old_edge = _selinfo[fd].edge;
+#endif
 
     // add the elements
     if (add_read)
 	_pollfds[pi].events |= POLLIN;
     if (add_write)
 	_pollfds[pi].events |= POLLOUT;
+    if (edge)
+	_selinfo[fd].edge = true;
+
+#if HAVE_ALLOW_EPOLL
+    int r = 0;
+    if (_epoll >= 0 && !_selinfo[fd].noepoll)
+	r = update_epoll(fd, old_events);
+    if (r < 0 && r != -EBADF) {
+	// Not all file descriptors are epollable (regular files, for
+	// example).  Check this one on the side without blocking, as
+	// poll() would, and leave the others in epoll.
+	_selinfo[fd].noepoll = true;
+	_noepoll_fds.push_back(fd);
+    } else if (r < 0) {
+	// not an open file descriptor at all
+	_selinfo[fd].edge = old_edge;
+	if (old_events)
+	    _pollfds[pi].events = old_events;
+	else {
+	    _pollfds[pi] = _pollfds.back();
+	    _pollfds.pop_back();
+	    _selinfo[fd].pollfd = -1;
+	    if (pi < _pollfds.size())
+		_selinfo[_pollfds[pi].fd].pollfd = pi;
+	}
+	return -1;
+    }
+#endif
 
 #if HAVE_ALLOW_KQUEUE
     if (_kqueue >= 0) {
@@ -181,6 +273,9 @@ SelectSet::register_select(int fd, bool add_read, bool add_write)
 	static int warned = 0;
 # if HAVE_ALLOW_KQUEUE
 	if (_kqueue < 0)
+# endif
+# if HAVE_ALLOW_EPOLL
+	if (_epoll < 0)
 # endif
 	    if (!warned) {
 		click_chatter("SelectSet::add_select(%d): fd >= FD_SETSIZE", fd);
@@ -192,6 +287,7 @@ SelectSet::register_select(int fd, bool add_read, bool add_write)
     // ensure the element selector exists
     if (fd >= _selinfo.size())
 	_selinfo.resize(fd + 1);
+    return 0;
 }
 
 int
@@ -201,7 +297,7 @@ SelectSet::add_select(int fd, Element *element, int mask)
 	return -1;
     if (mask == 0)
 	return 0;
-    assert(element && (mask & ~(SELECT_READ | SELECT_WRITE)) == 0);
+    assert(element && (mask & ~(SELECT_READ | SELECT_WRITE | SELECT_EDGE)) == 0);
     lock();
 
     // check whether to add readability, writability, or both; it is an error
@@ -228,7 +324,8 @@ SelectSet::add_select(int fd, Element *element, int mask)
     }
 
     // add the pollfd
-    register_select(fd, add_read, add_write);
+    if (register_select(fd, add_read, add_write, mask & SELECT_EDGE) < 0)
+	goto unlock_and_return_error;
 
     // add the elements
     if (add_read)
@@ -252,6 +349,9 @@ SelectSet::remove_pollfd(int pi, int event)
 
     // remove event
     int fd = _pollfds[pi].fd;
+#if HAVE_ALLOW_EPOLL
+    int old_events = _pollfds[pi].events;
+#endif
     _pollfds[pi].events &= ~event;
     if (event == POLLIN)
 	_selinfo[fd].read = 0;
@@ -277,8 +377,13 @@ SelectSet::remove_pollfd(int pi, int event)
 #endif
 
     // exit unless there are no events left
-    if (_pollfds[pi].events)
+    if (_pollfds[pi].events) {
+#if HAVE_ALLOW_EPOLL
+	if (_epoll >= 0 && !_selinfo[fd].noepoll)
+	    update_epoll(fd, old_events);
+#endif
 	return;
+    }
 
     // remove whole pollfd
     _pollfds[pi] = _pollfds.back();
@@ -286,6 +391,13 @@ SelectSet::remove_pollfd(int pi, int event)
     _selinfo[fd].pollfd = -1;
     if (pi < _pollfds.size())
 	_selinfo[_pollfds[pi].fd].pollfd = pi;
+#if HAVE_ALLOW_EPOLL
+    if (_selinfo[fd].noepoll)
+	remove_noepoll(fd);
+    else if (_epoll >= 0)
+	update_epoll(fd, old_events);
+#endif
+    _selinfo[fd].edge = false;
 #if !HAVE_ALLOW_POLL
     if (fd == _max_select_fd) {
 	_max_select_fd = -1;
@@ -302,7 +414,7 @@ SelectSet::remove_select(int fd, Element *element, int mask)
 {
     if (fd < 0)
 	return -1;
-    assert(element && (mask & ~(SELECT_READ | SELECT_WRITE)) == 0);
+    assert(element && (mask & ~(SELECT_READ | SELECT_WRITE | SELECT_EDGE)) == 0);
     lock();
 
     bool remove_read = false, remove_write = false;
@@ -390,7 +502,7 @@ SelectSet::run_selects_kqueue(RouterThread *thread)
     // Decide how long to wait.
     struct timespec wait, *wait_ptr = &wait;
     Timestamp t;
-    int delay_type = thread->timer_set().next_timer_delay(thread->active(), t);
+    int delay_type = thread->timer_set().next_timer_delay(thread->select_nonblocking(), t);
     if (delay_type == 0)
 	wait.tv_sec = wait.tv_nsec = 0;
     else if (delay_type > 0)
@@ -424,6 +536,78 @@ SelectSet::run_selects_kqueue(RouterThread *thread)
 }
 #endif /* HAVE_ALLOW_KQUEUE */
 
+#if HAVE_ALLOW_EPOLL
+void
+SelectSet::run_selects_epoll(RouterThread *thread)
+{
+    // The fds epoll refused are checked without blocking first; any
+    // ready one makes the wait nonblocking.
+    Vector<struct pollfd> noepoll;
+    for (int i = 0; i < _noepoll_fds.size(); ++i)
+	noepoll.push_back(_pollfds[_selinfo[_noepoll_fds[i]].pollfd]);
+    int nnoepoll = 0;
+    if (noepoll.size()) {
+# if HAVE_ALLOW_POLL
+	nnoepoll = poll(noepoll.begin(), noepoll.size(), 0);
+# else
+	// without poll(), take them as always ready, as regular files are
+	nnoepoll = noepoll.size();
+# endif
+    }
+
+# if HAVE_MULTITHREAD
+    // Registrations live in the kernel, so other threads may add and
+    // remove selects while we block without a private copy.
+    click_fence();
+    _select_lock.release();
+# endif
+
+    // Decide how long to wait.
+    int timeout;
+    Timestamp t;
+    int delay_type = thread->timer_set().next_timer_delay(thread->select_nonblocking() || nnoepoll > 0, t);
+    if (delay_type == 0)
+	timeout = 0;
+    else if (delay_type > 0)
+	timeout = (t.sec() >= INT_MAX / 1000 ? INT_MAX - 1000 : t.msecval());
+    else
+	timeout = -1;
+    thread->set_thread_state_for_blocking(delay_type);
+
+    struct epoll_event ev[256];
+    int n = epoll_wait(_epoll, &ev[0], 256, timeout);
+    int was_errno = errno;
+
+    if (post_select(thread, true))
+	return;
+
+    thread->set_thread_state(RouterThread::S_RUNSELECT);
+    if (n < 0 && was_errno != EINTR)
+	perror("epoll_wait");
+    else
+	// Only ready fds are returned.  call_selected() looks each fd up in
+	// _selinfo at call time, so removals by earlier callbacks are safe.
+	for (int i = 0; i < n; ++i) {
+	    int mask = (ev[i].events & ~EPOLLOUT ? Element::SELECT_READ : 0)
+		+ (ev[i].events & ~EPOLLIN ? Element::SELECT_WRITE : 0);
+	    call_selected(ev[i].data.fd, mask);
+	}
+
+    for (int i = 0; nnoepoll > 0 && i < noepoll.size(); ++i) {
+# if HAVE_ALLOW_POLL
+	int revents = noepoll[i].revents;
+# else
+	int revents = noepoll[i].events;
+# endif
+	if (revents) {
+	    int mask = (revents & ~POLLOUT ? Element::SELECT_READ : 0)
+		+ (revents & ~POLLIN ? Element::SELECT_WRITE : 0);
+	    call_selected(noepoll[i].fd, mask);
+	}
+    }
+}
+#endif /* HAVE_ALLOW_EPOLL */
+
 #if HAVE_ALLOW_POLL
 void
 SelectSet::run_selects_poll(RouterThread *thread)
@@ -441,7 +625,7 @@ SelectSet::run_selects_poll(RouterThread *thread)
     // Decide how long to wait.
     int timeout;
     Timestamp t;
-    int delay_type = thread->timer_set().next_timer_delay(thread->active(), t);
+    int delay_type = thread->timer_set().next_timer_delay(thread->select_nonblocking(), t);
     if (delay_type == 0)
 	timeout = 0;
     else if (delay_type > 0)
@@ -497,7 +681,7 @@ SelectSet::run_selects_select(RouterThread *thread)
     // Decide how long to wait.
     struct timeval wait, *wait_ptr = &wait;
     Timestamp t;
-    int delay_type = thread->timer_set().next_timer_delay(thread->active(), t);
+    int delay_type = thread->timer_set().next_timer_delay(thread->select_nonblocking(), t);
     if (delay_type == 0)
 	timerclear(&wait);
     else if (delay_type > 0)
@@ -559,9 +743,9 @@ SelectSet::run_selects(RouterThread *thread)
     }
 
     // Return early (just run signals) if there are no selectors and there are
-    // tasks to run.  NB there will always be at least one _pollfd (the
-    // _wake_pipe).
-    if (_pollfds.size() < 2 && thread->active()) {
+    // tasks to run, or the thread is spinning while idle.  NB there will
+    // always be at least one _pollfd (the _wake_pipe).
+    if (_pollfds.size() < 2 && thread->select_nonblocking()) {
 #if HAVE_MULTITHREAD
 	_select_lock.release();
 #endif
@@ -571,6 +755,12 @@ SelectSet::run_selects(RouterThread *thread)
 
     // Call the relevant selector implementation.
     do {
+#if HAVE_ALLOW_EPOLL
+	if (_epoll >= 0) {
+	    run_selects_epoll(thread);
+	    break;
+	}
+#endif
 #if HAVE_ALLOW_KQUEUE
 	if (_kqueue >= 0) {
 	    run_selects_kqueue(thread);
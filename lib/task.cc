@@ -110,7 +110,11 @@ Task::error_hook(Task *, void *)
 
 Task::~Task()
 {
+#if HAVE_MULTITHREAD
+    if (scheduled() || _pending_nextptr || _steal_offered)
+#else
     if (scheduled() || _pending_nextptr)
+#endif
 	cleanup();
 }
 
@@ -201,6 +205,10 @@ Task::initialize(Element *owner, bool schedule)
 #if HAVE_STRIDE_SCHED
     set_tickets(DEFAULT_TICKETS);
 #endif
+#if HAVE_MULTITHREAD
+    if (ThreadSched *ts = router->thread_sched())
+	_migratable = ts->initial_migratable(owner);
+#endif
 
     _status.home_thread_id = _thread->thread_id();
     _status.is_scheduled = schedule;
@@ -243,6 +251,21 @@ Task::cleanup()
 		/* do nothing */;
 	}
 
+#if HAVE_MULTITHREAD
+	// Likewise, withdraw any offer to idle threads, or wait for a
+	// thread that has claimed the offer to finish with it.
+	if (_steal_offered) {
+	    Master *m = master();
+	    for (int tid = 0; tid < m->nthreads(); ++tid)
+		if (m->thread(tid)->_steal_deque.retract(this)) {
+		    _steal_offered = false;
+		    break;
+		}
+	    while (_steal_offered)
+		/* do nothing */;
+	}
+#endif
+
 	_owner = 0;
 	_thread = 0;
     }
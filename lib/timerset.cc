@@ -48,6 +48,13 @@ TimerSet::TimerSet()
 #endif
     _timer_check = Timestamp::now_steady();
     _timer_check_reports = 0;
+
+    memset(_wheel, 0, sizeof(_wheel));
+    memset(_wheel_occupied, 0, sizeof(_wheel_occupied));
+    memset(_wheel_level_count, 0, sizeof(_wheel_level_count));
+    _wheel_count = 0;
+    _wheel_granularity = 1000;
+    _wheel_tick = int_divide((uint64_t) _timer_check.usecval(), _wheel_granularity);
 }
 
 void
@@ -66,6 +73,17 @@ TimerSet::kill_router(Router *router)
 	    t->_schedpos1 = 0;
 	}
     }
+    for (int level = 0; level < wheel_levels; ++level)
+	for (int slot = 0; slot < wheel_size; ++slot)
+	    for (Timer *t = _wheel[level][slot], *next; t; t = next) {
+		next = t->_wheel_next;
+		if (t->router() == router) {
+		    wheel_remove(t);
+		    t->_owner = 0;
+		    t->_schedpos1 = 0;
+		}
+	    }
+    set_wheel_expiry();
     set_timer_expiry();
     unlock_timers();
 }
@@ -78,6 +96,181 @@ TimerSet::set_max_timer_stride(unsigned timer_stride)
 	_timer_stride = _max_timer_stride;
 }
 
+/** @brief Return the tick length of the coarse timer wheel. */
+Timestamp
+TimerSet::wheel_granularity() const
+{
+    return Timestamp::make_usec(_wheel_granularity);
+}
+
+/** @brief Set the tick length of the coarse timer wheel.
+ *
+ * Coarse timers fire at the first tick boundary after their expiry, so a
+ * larger granularity means fewer wakeups and later firing.  Timers already
+ * in the wheel are moved to the new ticks.  The granularity is at least 1
+ * usec and at most an hour.
+ *
+ * The wheel's four levels of 256 slots span 256^4 = 2^32 ticks, about 49.7
+ * days at the default 1 msec.  Timers further away wait in the top level
+ * and are placed again when it cascades. */
+void
+TimerSet::set_wheel_granularity(const Timestamp &granularity)
+{
+    Timestamp::value_type g = granularity.usecval();
+    if (g < 1)
+	g = 1;
+    else if (g > (Timestamp::value_type) 3600 * 1000000)
+	g = (Timestamp::value_type) 3600 * 1000000;
+
+    lock_timers();
+    Vector<Timer *> moved;
+    for (int level = 0; level < wheel_levels; ++level)
+	for (int slot = 0; slot < wheel_size; ++slot)
+	    while (Timer *t = _wheel[level][slot]) {
+		wheel_remove(t);
+		moved.push_back(t);
+	    }
+    _wheel_granularity = g;
+    _wheel_tick = int_divide((uint64_t) Timestamp::recent_steady().usecval(), _wheel_granularity);
+    for (Vector<Timer *>::iterator it = moved.begin(); it != moved.end(); ++it)
+	wheel_insert(*it);
+    set_wheel_expiry();
+    set_timer_expiry();
+    unlock_timers();
+}
+
+inline uint64_t
+TimerSet::wheel_expiry_tick(Timer *t) const
+{
+    // the first tick boundary strictly after the expiry, so a coarse timer
+    // never fires early
+    return int_divide((uint64_t) t->_expiry_s.usecval(), _wheel_granularity) + 1;
+}
+
+// Return how many slots after idx, wrapping, the first nonempty slot of
+// level is, or -1 if the level is empty.
+int
+TimerSet::wheel_next_slot(int level, int idx) const
+{
+    const uint64_t *occupied = _wheel_occupied[level];
+    for (int i = 0; i <= wheel_size / 64; ++i) {
+	int w = ((idx >> 6) + i) % (wheel_size / 64);
+	uint64_t bits = occupied[w];
+	if (i == 0)
+	    bits &= ~(uint64_t) 0 << (idx & 63);
+	else if (i == wheel_size / 64)
+	    bits &= ~(~(uint64_t) 0 << (idx & 63));
+	if (bits)
+	    return (w * 64 + ffs_lsb(bits) - 1 - idx) & wheel_mask;
+    }
+    return -1;
+}
+
+uint64_t
+TimerSet::wheel_next_tick() const
+{
+    // A level 0 slot is due at its own tick; a higher level slot when it
+    // cascades, at the first tick from _wheel_tick on that is a multiple
+    // of 256^L and has the slot in bits [8L, 8L+8).
+    uint64_t next = ~(uint64_t) 0;
+    for (int level = 0; level < wheel_levels; ++level)
+	if (_wheel_level_count[level]) {
+	    int shift = wheel_bits * level;
+	    uint64_t base = (_wheel_tick + ((uint64_t) 1 << shift) - 1) >> shift;
+	    int d = wheel_next_slot(level, base & wheel_mask);
+	    if (d >= 0 && ((base + d) << shift) < next)
+		next = (base + d) << shift;
+	}
+    return next;
+}
+
+void
+TimerSet::set_wheel_expiry()
+{
+    if (_wheel_count)
+	_wheel_expiry = Timestamp::make_usec((Timestamp::value_type) (wheel_next_tick() * _wheel_granularity));
+    else
+	_wheel_expiry = Timestamp();
+}
+
+void
+TimerSet::wheel_insert(Timer *t)
+{
+    if (!_wheel_count) {
+	// an empty wheel may restart at the current tick
+	uint64_t now_tick = int_divide((uint64_t) Timestamp::recent_steady().usecval(), _wheel_granularity);
+	if (now_tick > _wheel_tick)
+	    _wheel_tick = now_tick;
+    }
+
+    uint64_t tick = wheel_expiry_tick(t);
+    if (tick < _wheel_tick)
+	tick = _wheel_tick;
+    uint64_t delta = tick - _wheel_tick;
+    int level = 0;
+    while (level < wheel_levels - 1
+	   && delta >= ((uint64_t) 1 << (wheel_bits * (level + 1))))
+	++level;
+    if (delta >= ((uint64_t) 1 << (wheel_bits * wheel_levels)))
+	// too far away; park in the top level and reinsert on cascade
+	tick = _wheel_tick + ((uint64_t) 1 << (wheel_bits * wheel_levels)) - 1;
+    int slot = (tick >> (wheel_bits * level)) & wheel_mask;
+
+    Timer **head = &_wheel[level][slot];
+    t->_wheel_next = *head;
+    t->_wheel_pprev = head;
+    if (*head)
+	(*head)->_wheel_pprev = &t->_wheel_next;
+    *head = t;
+    t->_schedpos1 = wheel_schedpos1 + level;
+    _wheel_occupied[level][slot >> 6] |= (uint64_t) 1 << (slot & 63);
+    ++_wheel_level_count[level];
+    ++_wheel_count;
+
+    // the wheel next needs attention when this slot is due, which for a
+    // higher level is its cascade
+    tick &= ~(((uint64_t) 1 << (wheel_bits * level)) - 1);
+    Timestamp expiry = Timestamp::make_usec((Timestamp::value_type) (tick * _wheel_granularity));
+    if (_wheel_count == 1 || expiry < _wheel_expiry) {
+	_wheel_expiry = expiry;
+	set_timer_expiry();
+    }
+}
+
+void
+TimerSet::wheel_remove(Timer *t)
+{
+    Timer **pprev = t->_wheel_pprev;
+    *pprev = t->_wheel_next;
+    if (t->_wheel_next)
+	t->_wheel_next->_wheel_pprev = pprev;
+
+    // timers waiting to run are on a private list and not counted
+    int level = t->_schedpos1 - wheel_schedpos1;
+    if (level < wheel_levels) {
+	if (!*pprev
+	    && pprev >= &_wheel[level][0] && pprev < &_wheel[level][wheel_size]) {
+	    int slot = pprev - &_wheel[level][0];
+	    _wheel_occupied[level][slot >> 6] &= ~((uint64_t) 1 << (slot & 63));
+	}
+	--_wheel_level_count[level];
+	--_wheel_count;
+    }
+    // A stale _wheel_expiry only costs one early run_timers pass.
+}
+
+void
+TimerSet::wheel_cascade(int level, int slot)
+{
+    Timer *t = _wheel[level][slot];
+    while (t) {
+	Timer *next = t->_wheel_next;
+	wheel_remove(t);
+	wheel_insert(t);
+	t = next;
+    }
+}
+
 void
 TimerSet::check_timer_expiry(Timer *t)
 {
@@ -110,12 +303,64 @@ TimerSet::run_one_timer(Timer *t)
 #endif
 }
 
+void
+TimerSet::run_wheel(RouterThread *thread)
+{
+    uint64_t now_tick = int_divide((uint64_t) _timer_check.usecval(), _wheel_granularity);
+    while (_wheel_count && !thread->stop_flag()) {
+	// skip straight to the next tick with work to do
+	uint64_t tick = wheel_next_tick();
+	if (tick > now_tick)
+	    break;
+	_wheel_tick = tick;
+
+	int idx = tick & wheel_mask;
+	for (int level = 1; level < wheel_levels && !idx; ++level) {
+	    idx = (tick >> (wheel_bits * level)) & wheel_mask;
+	    wheel_cascade(level, idx);
+	}
+	idx = tick & wheel_mask;
+
+	// move this tick's timers to a private list; callbacks may
+	// unschedule any of them
+	Timer *runlist = _wheel[0][idx];
+	_wheel[0][idx] = 0;
+	_wheel_occupied[0][idx >> 6] &= ~((uint64_t) 1 << (idx & 63));
+	if (runlist)
+	    runlist->_wheel_pprev = &runlist;
+	for (Timer *t = runlist; t; t = t->_wheel_next) {
+	    t->_schedpos1 = wheel_schedpos1 + wheel_levels;
+	    --_wheel_level_count[0];
+	    --_wheel_count;
+	}
+	_wheel_tick = tick + 1;
+	set_wheel_expiry();
+	set_timer_expiry();
+
+	while (Timer *t = runlist) {
+	    runlist = t->_wheel_next;
+	    if (runlist)
+		runlist->_wheel_pprev = &runlist;
+	    if (thread->stop_flag())
+		// reschedule unrun timers if stopped early
+		wheel_insert(t);
+	    else {
+		t->_schedpos1 = 0;
+		run_one_timer(t);
+	    }
+	}
+    }
+    set_wheel_expiry();
+    set_timer_expiry();
+}
+
 void
 TimerSet::run_timers(RouterThread *thread, Master *master)
 {
     if (!_timer_lock.attempt())
 	return;
-    if (!master->paused() && _timer_heap.size() > 0 && !thread->stop_flag()) {
+    if (!master->paused() && (_timer_heap.size() > 0 || _wheel_count > 0)
+	&& !thread->stop_flag()) {
 	thread->set_thread_state(RouterThread::S_RUNTIMER);
 #if CLICK_LINUXMODULE
 	_timer_task = current;
@@ -125,7 +370,7 @@ TimerSet::run_timers(RouterThread *thread, Master *master)
 	_timer_check = Timestamp::now_steady();
 	heap_element *th = _timer_heap.begin();
 
-	if (th->expiry_s <= _timer_check) {
+	if (_timer_heap.size() > 0 && th->expiry_s <= _timer_check) {
 	    // potentially adjust timer stride
 	    Timestamp adj_expiry = th->expiry_s + Timer::adjustment();
 	    if (adj_expiry <= _timer_check) {
@@ -188,6 +433,9 @@ TimerSet::run_timers(RouterThread *thread, Master *master)
 	    }
 	}
 
+	if (_wheel_count > 0 && _wheel_expiry <= _timer_check)
+	    run_wheel(thread);
+
 #if CLICK_LINUXMODULE
 	_timer_task = 0;
 #elif HAVE_MULTITHREAD
@@ -74,14 +74,21 @@ CLICK_USING_DECLS
 #define THREADS_OPT		316
 #define SIMTIME_OPT		317
 #define SOCKET_OPT		318
+#define BUFFER_SIZE_OPT		319
+#define JUMBO_SIZE_OPT		320
+#define HUGEPAGES_OPT		321
+#define WORK_STEALING_OPT	322
 
 static const Clp_Option options[] = {
     { "allow-reconfigure", 'R', ALLOW_RECONFIG_OPT, 0, Clp_Negate },
+    { "buffer-size", 0, BUFFER_SIZE_OPT, Clp_ValUnsigned, 0 },
     { "clickpath", 'C', CLICKPATH_OPT, Clp_ValString, 0 },
     { "expression", 'e', EXPRESSION_OPT, Clp_ValString, 0 },
     { "file", 'f', ROUTER_OPT, Clp_ValString, 0 },
     { "handler", 'h', HANDLER_OPT, Clp_ValString, 0 },
     { "help", 0, HELP_OPT, 0, 0 },
+    { "hugepages", 0, HUGEPAGES_OPT, 0, Clp_Negate },
+    { "jumbo-buffer-size", 0, JUMBO_SIZE_OPT, Clp_ValUnsigned, 0 },
     { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
     { "socket", 0, SOCKET_OPT, Clp_ValInt, 0 },
     { "port", 'p', PORT_OPT, Clp_ValString, 0 },
@@ -93,6 +100,7 @@ static const Clp_Option options[] = {
     { "unix-socket", 'u', UNIX_SOCKET_OPT, Clp_ValString, 0 },
     { "version", 'v', VERSION_OPT, 0, 0 },
     { "warnings", 0, WARNINGS_OPT, 0, Clp_Negate },
+    { "work-stealing", 0, WORK_STEALING_OPT, 0, Clp_Negate },
     { "exit-handler", 'x', EXIT_HANDLER_OPT, Clp_ValString, 0 },
     { 0, 'w', NO_WARNINGS_OPT, 0, Clp_Negate },
 };
@@ -121,6 +129,10 @@ Options:\n\
   -f, --file FILE               Read router configuration from FILE.\n\
   -e, --expression EXPR         Use EXPR as router configuration.\n\
   -j, --threads N               Start N threads (default 1).\n\
+      --work-stealing           Let idle threads steal migratable tasks.\n\
+      --buffer-size N           Pool packet buffers of N bytes (default 2048).\n\
+      --jumbo-buffer-size N     Also pool jumbo packet buffers of N bytes.\n\
+      --hugepages               Allocate pooled packet buffers in huge pages.\n\
   -p, --port PORT               Listen for control connections on TCP port.\n\
   -u, --unix-socket FILE        Listen for control connections on Unix socket.\n\
       --socket FD               Add a file descriptor control connection.\n\
@@ -296,6 +308,7 @@ static Vector<String> cs_ports;
 static Vector<String> cs_sockets;
 static bool warnings = true;
 static int nthreads = 1;
+static bool work_stealing = false;
 
 static String
 click_driver_control_socket_name(int number)
@@ -313,8 +326,10 @@ parse_configuration(const String &text, bool text_is_expr, bool hotswap,
     Master *new_master = 0, *master;
     if (router)
 	master = router->master();
-    else
+    else {
 	master = new_master = new Master(nthreads);
+	master->set_work_stealing(work_stealing);
+    }
 
     Router *r = click_read_router(text, text_is_expr, errh, false, master);
     if (!r) {
@@ -461,6 +476,8 @@ main(int argc, char **argv)
   bool allow_reconfigure = false;
   Vector<String> handlers;
   String exit_handler;
+  uint32_t buffer_size = 0, jumbo_size = 0;
+  bool hugepages = false;
 
   while (1) {
     int opt = Clp_Next(clp);
@@ -552,6 +569,26 @@ main(int argc, char **argv)
       warnings = clp->negated;
       break;
 
+     case BUFFER_SIZE_OPT:
+      buffer_size = clp->val.u;
+      break;
+
+     case JUMBO_SIZE_OPT:
+      jumbo_size = clp->val.u;
+      break;
+
+     case HUGEPAGES_OPT:
+      hugepages = !clp->negated;
+      break;
+
+     case WORK_STEALING_OPT:
+      work_stealing = !clp->negated;
+#if !HAVE_MULTITHREAD
+      if (work_stealing)
+	  errh->warning("Click was built without multithread support, ignoring --work-stealing");
+#endif
+      break;
+
      case THREADS_OPT:
       nthreads = clp->val.i;
       if (nthreads <= 1)
@@ -603,6 +640,18 @@ particular purpose.\n");
   }
 
  done:
+  // configure the packet pool before any packets exist
+  if (buffer_size || jumbo_size || hugepages) {
+#if HAVE_CLICK_PACKET_POOL
+      if (int r = Packet::configure_pool(buffer_size, jumbo_size, hugepages)) {
+	  errh->error("packet pool: %s", strerror(-r));
+	  return cleanup(clp, 1);
+      }
+#else
+      errh->warning("Click was built without a packet pool, ignoring buffer options");
+#endif
+  }
+
   // provide hotconfig handler if asked
   if (allow_reconfigure)
       Router::add_write_handler(0, "hotconfig", hotconfig_handler, 0, Handler::RAW | Handler::NONEXCLUSIVE);